@@ -0,0 +1,396 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QFile>
+#include <QGlobalStatic>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QStandardPaths>
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "aggregator_p.h"
+
+Q_LOGGING_CATEGORY(SOLID_AGGREGATOR, "solid.power.aggregator")
+
+#define SEGMENT_FILE_NAME QStringLiteral("solid-power.shm")
+#define SEGMENT_MAGIC 0x47415053 // "SPAG"
+#define SEGMENT_VERSION 2
+#define LIVENESS_INTERVAL 5000 // msecs between the readers' checks that the aggregator still runs
+
+using namespace Aggregator;
+
+/*
+ * Layout of the shared memory segment. The sequence counter is odd while the
+ * state is being written; readers retry until they get the same even value
+ * before and after copying it. It is also the futex word the watchers wait on.
+ */
+struct Aggregator::SharedSegment
+{
+    quint32 magic;
+    quint32 version;
+    std::atomic<quint32> sequence;
+    std::atomic<qint32> publisherPid; // 0 until the first publish, and after the publisher exited
+    SharedState state;
+};
+
+static_assert(sizeof(std::atomic<quint32>) == sizeof(quint32), "the futex word has to be a plain 32 bit integer");
+
+static QString segmentPath()
+{
+    const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty()) {
+        return QString();
+    }
+    return runtimeDir + QLatin1Char('/') + SEGMENT_FILE_NAME;
+}
+
+static qint64 monotonicMSecs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void futexWait(std::atomic<quint32> *word, quint32 expected)
+{
+#ifdef Q_OS_LINUX
+    // not FUTEX_PRIVATE_FLAG: the word is shared with the other processes
+    syscall(SYS_futex, reinterpret_cast<quint32 *>(word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+#else
+    Q_UNUSED(word)
+    Q_UNUSED(expected)
+    usleep(250 * 1000);
+#endif
+}
+
+static void futexWake(std::atomic<quint32> *word)
+{
+#ifdef Q_OS_LINUX
+    syscall(SYS_futex, reinterpret_cast<quint32 *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    Q_UNUSED(word)
+#endif
+}
+
+void SharedState::setText(char *buffer, size_t size, const QString &text)
+{
+    QByteArray utf8 = text.toUtf8();
+    // don't cut a multi-byte sequence in half
+    while (size_t(utf8.size()) >= size) {
+        utf8.chop(1);
+        while (!utf8.isEmpty() && (uchar(utf8.at(utf8.size() - 1)) & 0xC0) == 0x80) {
+            utf8.chop(1);
+        }
+        if (!utf8.isEmpty() && (uchar(utf8.at(utf8.size() - 1)) & 0x80)) {
+            utf8.chop(1);
+        }
+    }
+    memset(buffer, 0, size);
+    memcpy(buffer, utf8.constData(), utf8.size());
+}
+
+QString SharedState::text(const char *buffer, size_t size)
+{
+    return QString::fromUtf8(buffer, strnlen(buffer, size));
+}
+
+/*
+ * The client side: maps the segment and, when read, checks now and then that
+ * its publisher still runs. A mapping is never unmapped, readers might be
+ * using it.
+ */
+class AggregatorClient
+{
+public:
+    // a recording or replaying backend has to see the bus inputs itself
+    AggregatorClient()
+        : m_enabled(qgetenv("SOLID_POWER_AGGREGATOR") != "0"
+                    && qEnvironmentVariableIsEmpty("SOLID_POWER_RECORD")
+                    && qEnvironmentVariableIsEmpty("SOLID_POWER_REPLAY"))
+    {
+    }
+
+    ~AggregatorClient()
+    {
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+    }
+
+    SharedSegment *segment()
+    {
+        if (!m_enabled) {
+            return nullptr;
+        }
+
+        const qint64 now = monotonicMSecs();
+        if (now < m_nextCheck.load(std::memory_order_relaxed)) {
+            SharedSegment *segment = m_alive.load(std::memory_order_acquire);
+            return segment && segment->publisherPid.load(std::memory_order_relaxed) != 0 ? segment : nullptr;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_nextCheck = now + LIVENESS_INTERVAL;
+        SharedSegment *alive = nullptr;
+        if (attach()) {
+            SharedSegment *segment = m_segment.load(std::memory_order_relaxed);
+            if (segment->publisherPid.load(std::memory_order_relaxed) != 0 && publisherAlive()) {
+                alive = segment;
+            }
+        }
+        SharedSegment *previous = m_alive.exchange(alive, std::memory_order_acq_rel);
+        if (previous && previous != alive && previous->publisherPid.load(std::memory_order_relaxed) != 0) {
+            // it crashed, without bumping the sequence: wake the watchers up, they don't time out
+            futexWake(&previous->sequence);
+        }
+        return alive;
+    }
+
+private:
+    bool attach()
+    {
+        const QString path = segmentPath();
+        if (path.isEmpty()) {
+            return false;
+        }
+
+        struct stat st;
+        if (::stat(QFile::encodeName(path).constData(), &st) != 0 || st.st_size < off_t(sizeof(SharedSegment))) {
+            return false;
+        }
+        if (m_segment.load(std::memory_order_relaxed) && st.st_ino == m_inode) {
+            return true;
+        }
+
+        // first time, or the aggregator started over with a new file
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        void *map = mmap(nullptr, sizeof(SharedSegment), PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        SharedSegment *segment = static_cast<SharedSegment *>(map);
+        if (segment->magic != SEGMENT_MAGIC || segment->version != SEGMENT_VERSION) {
+            munmap(map, sizeof(SharedSegment));
+            close(fd);
+            return false;
+        }
+
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+        m_fd = fd;
+        m_inode = st.st_ino;
+        m_segment.store(segment, std::memory_order_release);
+        qCDebug(SOLID_AGGREGATOR) << "Using the session aggregator at" << path;
+        return true;
+    }
+
+    bool publisherAlive() const
+    {
+        // the publisher holds an exclusive lock for as long as it runs, crashes included
+        if (flock(m_fd, LOCK_SH | LOCK_NB) == 0) {
+            flock(m_fd, LOCK_UN);
+            return false;
+        }
+        return errno == EWOULDBLOCK;
+    }
+
+    const bool m_enabled;
+    QMutex m_mutex;
+    int m_fd = -1;
+    ino_t m_inode = 0;
+    std::atomic<SharedSegment *> m_segment {nullptr};
+    std::atomic<SharedSegment *> m_alive {nullptr}; // as of the last check
+    std::atomic<qint64> m_nextCheck {0};
+};
+
+Q_GLOBAL_STATIC(AggregatorClient, globalAggregatorClient)
+
+bool Aggregator::read(SharedState &state)
+{
+    SharedSegment *segment = globalAggregatorClient->segment();
+    if (!segment) {
+        return false;
+    }
+
+    // seqlock: retry while the publisher is writing
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        const quint32 before = segment->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(&state, &segment->state, sizeof(SharedState));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment->sequence.load(std::memory_order_relaxed) == before) {
+            return segment->publisherPid.load(std::memory_order_relaxed) != 0;
+        }
+    }
+    return false;
+}
+
+Watcher::Watcher(const std::function<void()> &callback)
+    : m_callback(callback),
+      m_stop(false),
+      m_done(false),
+      m_segment(nullptr),
+      m_thread(&Watcher::run, this)
+{
+}
+
+Watcher::~Watcher()
+{
+    m_stop = true;
+    // a wake up right before the watcher goes to sleep gets lost, insist until it's out
+    while (!m_done) {
+        if (SharedSegment *segment = m_segment) {
+            // wakes the other processes' watchers too, they just go back to waiting
+            futexWake(&segment->sequence);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    m_thread.join();
+}
+
+void Watcher::run()
+{
+    SharedSegment *segment = globalAggregatorClient->segment();
+    quint32 seen = segment ? segment->sequence.load(std::memory_order_acquire) : 0;
+    while (!m_stop) {
+        segment = globalAggregatorClient->segment();
+        if (!segment) {
+            // the aggregator went away
+            m_callback();
+            break;
+        }
+
+        // no timeout: an aggregator bumps the sequence when it exits, and one that
+        // crashed gets noticed by the next read, see AggregatorClient::segment()
+        m_segment = segment;
+        futexWait(&segment->sequence, seen);
+        if (m_stop) {
+            break;
+        }
+
+        const quint32 current = segment->sequence.load(std::memory_order_acquire);
+        if (current & 1) {
+            sched_yield(); // being written, wait for the end of it
+        } else if (current != seen) {
+            seen = current;
+            m_callback();
+        }
+    }
+    m_done = true;
+}
+
+Publisher::Publisher()
+{
+}
+
+Publisher::~Publisher()
+{
+    if (m_segment) {
+        // tell the clients to go to the bus themselves again
+        const quint32 sequence = m_segment->sequence.load(std::memory_order_relaxed);
+        m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_segment->publisherPid.store(0, std::memory_order_relaxed);
+        m_segment->sequence.store(sequence + 2, std::memory_order_release);
+        futexWake(&m_segment->sequence);
+        munmap(m_segment, sizeof(SharedSegment));
+    }
+    if (m_fd != -1) {
+        close(m_fd); // releases the lock
+    }
+}
+
+bool Publisher::open()
+{
+    const QString path = segmentPath();
+    if (path.isEmpty()) {
+        qCWarning(SOLID_AGGREGATOR) << "No runtime directory to put the shared state in";
+        return false;
+    }
+
+    // an existing file is reused rather than replaced, so that the clients' mappings stay valid
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd == -1) {
+        qCWarning(SOLID_AGGREGATOR) << "Cannot open" << path << strerror(errno);
+        return false;
+    }
+    if (flock(m_fd, LOCK_EX | LOCK_NB) != 0) {
+        qCWarning(SOLID_AGGREGATOR) << "Another aggregator is already running";
+        return false;
+    }
+    if (ftruncate(m_fd, sizeof(SharedSegment)) != 0) {
+        qCWarning(SOLID_AGGREGATOR) << "Cannot resize" << path << strerror(errno);
+        return false;
+    }
+
+    void *map = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        qCWarning(SOLID_AGGREGATOR) << "Cannot map" << path << strerror(errno);
+        return false;
+    }
+    m_segment = static_cast<SharedSegment *>(map);
+    m_segment->publisherPid.store(0, std::memory_order_relaxed);
+    m_segment->magic = SEGMENT_MAGIC;
+    m_segment->version = SEGMENT_VERSION;
+    // a previous aggregator might have died in the middle of a write
+    const quint32 sequence = m_segment->sequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+        m_segment->sequence.store(sequence + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+void Publisher::publish(const SharedState &state)
+{
+    if (!m_segment) {
+        return;
+    }
+
+    const quint32 sequence = m_segment->sequence.load(std::memory_order_relaxed);
+    m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&m_segment->state, &state, sizeof(SharedState));
+    m_segment->publisherPid.store(getpid(), std::memory_order_relaxed);
+    m_segment->sequence.store(sequence + 2, std::memory_order_release);
+    futexWake(&m_segment->sequence);
+}
@@ -0,0 +1,133 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+
+#include <csignal>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "powermanagement.h"
+#include "platform.h"
+#include "aggregator_p.h"
+
+using namespace Solid;
+
+static int s_signalFds[2];
+
+static void quitOnSignal(int)
+{
+    // only async-signal-safe calls here, the rest happens in the event loop
+    const char c = 1;
+    (void)::write(s_signalFds[0], &c, sizeof(c));
+}
+
+static quint32 capabilities()
+{
+    quint32 flags = 0;
+    if (PowerManagement::canSuspend()) {
+        flags |= Aggregator::CanSuspend;
+    }
+    if (PowerManagement::canHibernate()) {
+        flags |= Aggregator::CanHibernate;
+    }
+    if (PowerManagement::canHybridSleep()) {
+        flags |= Aggregator::CanHybridSleep;
+    }
+    if (PowerManagement::canSuspendThenHibernate()) {
+        flags |= Aggregator::CanSuspendThenHibernate;
+    }
+    if (PowerManagement::canReboot()) {
+        flags |= Aggregator::CanReboot;
+    }
+    if (PowerManagement::canShutdown()) {
+        flags |= Aggregator::CanShutdown;
+    }
+    return flags;
+}
+
+int main(int argc, char *argv[])
+{
+    // we are the source of the shared state, don't read it back
+    qputenv("SOLID_POWER_AGGREGATOR", "0");
+
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName(QStringLiteral("KDE"));
+    app.setOrganizationDomain(QStringLiteral("kde.org"));
+    app.setApplicationName(QStringLiteral("solidpower-aggregator"));
+
+    Aggregator::Publisher publisher;
+    if (!publisher.open()) {
+        return 1;
+    }
+
+    // leave through the event loop, so that the clients learn that we're gone
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalFds) == 0) {
+        QSocketNotifier *signalNotifier = new QSocketNotifier(s_signalFds[1], QSocketNotifier::Read, &app);
+        QObject::connect(signalNotifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+        signal(SIGTERM, quitOnSignal);
+        signal(SIGINT, quitOnSignal);
+        signal(SIGHUP, quitOnSignal);
+    }
+
+    // the capabilities are only re-checked after a resume, they hardly ever change
+    quint32 capabilityFlags = capabilities();
+
+    auto publish = [&publisher, &capabilityFlags]() {
+        Aggregator::SharedState state;
+        memset(&state, 0, sizeof(state));
+        state.flags = capabilityFlags;
+        if (PowerManagement::appShouldConserveResources()) {
+            state.flags |= Aggregator::OnBattery;
+        }
+        if (PowerManagement::hasLid()) {
+            state.flags |= Aggregator::HasLid;
+        }
+        if (PowerManagement::isLidClosed()) {
+            state.flags |= Aggregator::LidClosed;
+        }
+        state.chassis = Platform::chassis();
+        Aggregator::SharedState::setText(state.hostname, sizeof(state.hostname), Platform::hostname());
+        Aggregator::SharedState::setText(state.iconName, sizeof(state.iconName), Platform::iconName());
+        Aggregator::SharedState::setText(state.prettyOSName, sizeof(state.prettyOSName), Platform::prettyOSName());
+        publisher.publish(state);
+    };
+
+    PowerManagement::Notifier *notifier = PowerManagement::notifier();
+    QObject::connect(notifier, &PowerManagement::Notifier::appShouldConserveResourcesChanged, publish);
+    QObject::connect(notifier, &PowerManagement::Notifier::isLidClosedChanged, publish);
+    QObject::connect(notifier, &PowerManagement::Notifier::resumingFromSuspend, [&capabilityFlags, &publish]() {
+        capabilityFlags = capabilities();
+        publish();
+    });
+
+    Platform::Notifier *platformNotifier = Platform::notifier();
+    QObject::connect(platformNotifier, &Platform::Notifier::chassisChanged, publish);
+    QObject::connect(platformNotifier, &Platform::Notifier::hostnameChanged, publish);
+    QObject::connect(platformNotifier, &Platform::Notifier::iconNameChanged, publish);
+    QObject::connect(platformNotifier, &Platform::Notifier::prettyOSNameChanged, publish);
+
+    publish();
+
+    return app.exec();
+}
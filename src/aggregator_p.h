@@ -0,0 +1,120 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_AGGREGATOR_P_H
+#define SOLID_POWER_AGGREGATOR_P_H
+
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include <solidpower_export.h>
+
+/*
+ * Session-wide sharing of the power state.
+ *
+ * The solidpower-aggregator process tracks logind, UPower and hostname1 once
+ * for the whole session and publishes the state in a shared memory segment in
+ * $XDG_RUNTIME_DIR, protected by a seqlock. The other processes then read it
+ * with plain memory reads instead of setting up their own bus subscriptions
+ * and startup queries, and wait for changes with a futex on the sequence
+ * counter.
+ *
+ * Setting SOLID_POWER_AGGREGATOR=0 makes a process ignore the aggregator.
+ *
+ * The library exports what the solidpower-aggregator executable needs, so
+ * that it uses the library's copy of this code rather than its own.
+ */
+namespace Aggregator
+{
+struct SharedSegment;
+
+enum StateFlag {
+    OnBattery = 0x1,
+    HasLid = 0x2,
+    LidClosed = 0x4,
+    CanSuspend = 0x8,
+    CanHibernate = 0x10,
+    CanHybridSleep = 0x20,
+    CanReboot = 0x40,
+    CanShutdown = 0x80,
+    CanSuspendThenHibernate = 0x100
+};
+
+// the published state, plain data so that it can be copied in and out of the segment
+struct SOLIDPOWER_EXPORT SharedState
+{
+    quint32 flags; // StateFlag
+    qint32 chassis; // Solid::Platform::Chassis
+    char hostname[256]; // UTF-8, nul-terminated
+    char iconName[64];
+    char prettyOSName[256];
+
+    static void setText(char *buffer, size_t size, const QString &text);
+    static QString text(const char *buffer, size_t size);
+};
+
+/*
+ * Copies the published state; false when there's no aggregator running (or
+ * this process ignores it), the callers then go to the bus themselves.
+ */
+bool read(SharedState &state);
+
+/*
+ * Waits for changes to the published state on a thread of its own, and calls
+ * @p callback from it after each change, and when the aggregator goes away.
+ * The thread only wakes up for those.
+ */
+class Watcher
+{
+public:
+    explicit Watcher(const std::function<void()> &callback);
+    ~Watcher();
+
+private:
+    void run();
+
+    std::function<void()> m_callback;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_done;
+    std::atomic<SharedSegment *> m_segment; // the one waited on
+    std::thread m_thread;
+};
+
+// the aggregator's side of the segment
+class SOLIDPOWER_EXPORT Publisher
+{
+public:
+    Publisher();
+    ~Publisher();
+
+    // creates the segment; fails when another aggregator is running already
+    bool open();
+    void publish(const SharedState &state);
+
+private:
+    int m_fd = -1;
+    SharedSegment *m_segment = nullptr;
+};
+}
+
+#endif
@@ -0,0 +1,5 @@
+/* Define to 1 to compile in the trace points */
+#cmakedefine01 SOLIDPOWER_TRACING
+
+/* Define if <sys/sdt.h> is available for USDT probes */
+#cmakedefine HAVE_SYS_SDT_H
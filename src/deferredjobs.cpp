@@ -0,0 +1,451 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "deferredjobs.h"
+#include "deferredjobs_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "servicehealth_p.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QGlobalStatic>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QUrl>
+
+#include <algorithm>
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+#define UPOWER_SERVICE QStringLiteral("org.freedesktop.UPower")
+#define DISPLAY_DEVICE_PATH QStringLiteral("/org/freedesktop/UPower/devices/DisplayDevice")
+#define DEVICE_IFACE QStringLiteral("org.freedesktop.UPower.Device")
+#define DBUS_PROPS_IFACE QStringLiteral("org.freedesktop.DBus.Properties")
+
+#define JOBS_FILE_VERSION 1
+// a burst of submit() or finish() calls is written out once
+#define SAVE_DELAY 1000
+
+Q_GLOBAL_STATIC(BatteryLevelMonitor, globalBatteryLevel)
+
+BatteryLevelMonitor::BatteryLevelMonitor()
+{
+    QDBusConnection::systemBus().connect(UPOWER_SERVICE, DISPLAY_DEVICE_PATH, DBUS_PROPS_IFACE,
+                                         QStringLiteral("PropertiesChanged"),
+                                         this, SLOT(devicePropertiesChanged(QString, QVariantMap, QStringList)));
+
+    // we might be created from any thread, live in the library's one
+    IoThread::adopt(this);
+    QMetaObject::invokeMethod(this, "fetch", Qt::QueuedConnection);
+}
+
+BatteryLevelMonitor::~BatteryLevelMonitor()
+{
+}
+
+BatteryLevelMonitor *BatteryLevelMonitor::instance()
+{
+    return globalBatteryLevel;
+}
+
+int BatteryLevelMonitor::level() const
+{
+    return m_level;
+}
+
+void BatteryLevelMonitor::fetch()
+{
+    ServiceHealth *health = ServiceHealth::forService(UPOWER_SERVICE);
+    if (!health->allowCall()) {
+        return;
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(UPOWER_SERVICE, DISPLAY_DEVICE_PATH, DBUS_PROPS_IFACE, QStringLiteral("GetAll"));
+    msg << DEVICE_IFACE;
+    const QDBusPendingCall call = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+    DiagnosticsPrivate::trackPendingCall(UPOWER_SERVICE, QStringLiteral("GetAll ") + DEVICE_IFACE, call);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &BatteryLevelMonitor::levelReply);
+}
+
+void BatteryLevelMonitor::levelReply(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    ServiceHealth *health = ServiceHealth::forService(UPOWER_SERVICE);
+    const QDBusPendingReply<QVariantMap> reply = *watcher;
+    if (reply.isError()) {
+        health->recordFailure(reply.error());
+        qCDebug(SOLID_POWER) << "Cannot read the battery level:" << reply.error().message();
+        updateLevel(-1);
+        return;
+    }
+    health->recordSuccess();
+
+    // the display device is there on desktops as well, just not present
+    const QVariantMap props = reply.value();
+    const bool present = props.value(QStringLiteral("IsPresent")).toBool();
+    updateLevel(present ? qRound(props.value(QStringLiteral("Percentage")).toDouble()) : -1);
+}
+
+void BatteryLevelMonitor::devicePropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated)
+{
+    Q_UNUSED(invalidated)
+    DiagnosticsPrivate::signalReceived();
+    if (interface != DEVICE_IFACE) {
+        return;
+    }
+    if (changedProperties.contains(QStringLiteral("Percentage")) || changedProperties.contains(QStringLiteral("IsPresent"))) {
+        fetch();
+    }
+}
+
+void BatteryLevelMonitor::updateLevel(int level)
+{
+    if (m_level.exchange(level) != level) {
+        Q_EMIT levelChanged(level);
+    }
+}
+
+DeferredJobQueuePrivate::DeferredJobQueuePrivate(Solid::DeferredJobQueue *q, const QString &name)
+    : QObject(q)
+    , q(q)
+    , batchTimer(new QTimer(this))
+    , saveTimer(new QTimer(this))
+{
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    if (!dataDir.isEmpty()) {
+        QString appName = QCoreApplication::applicationName();
+        if (appName.isEmpty()) {
+            appName = QStringLiteral("unknown");
+        }
+        // percent-encoded, so that neither can reach outside of the jobs directory
+        filePath = dataDir + QStringLiteral("/solid-power/jobs/") + QString::fromLatin1(QUrl::toPercentEncoding(appName)) +
+                   QLatin1Char('-') + QString::fromLatin1(QUrl::toPercentEncoding(name)) + QStringLiteral(".json");
+    }
+
+    batchTimer->setSingleShot(true);
+    connect(batchTimer, &QTimer::timeout, this, &DeferredJobQueuePrivate::releaseBatch);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(SAVE_DELAY);
+    connect(saveTimer, &QTimer::timeout, this, &DeferredJobQueuePrivate::save);
+
+    Solid::PowerManagement::Notifier *notifier = Solid::PowerManagement::notifier();
+    connect(notifier, &Solid::PowerManagement::Notifier::appShouldConserveResourcesChanged,
+            this, &DeferredJobQueuePrivate::powerStateChanged);
+    connect(notifier, &Solid::PowerManagement::Notifier::powerProfileChanged,
+            this, &DeferredJobQueuePrivate::powerStateChanged);
+    connect(BatteryLevelMonitor::instance(), &BatteryLevelMonitor::levelChanged,
+            this, &DeferredJobQueuePrivate::powerStateChanged);
+
+    load();
+    schedule();
+}
+
+bool DeferredJobQueuePrivate::conditionsMet(const Solid::PowerConditions &conditions, bool conserving,
+                                            Solid::PowerManagement::PowerProfile profile, int batteryLevel)
+{
+    if (conditions.requireAC && conserving) {
+        return false;
+    }
+    if (conditions.avoidPowerSaver && profile == Solid::PowerManagement::PowerSaverProfile) {
+        return false;
+    }
+    // on AC, the battery level doesn't matter
+    if (conditions.minBatteryLevel > 0 && conserving && batteryLevel < conditions.minBatteryLevel) {
+        return false;
+    }
+    return true;
+}
+
+QList<DeferredJobQueuePrivate::Job> DeferredJobQueuePrivate::sortedJobs() const
+{
+    QList<Job> sorted = jobs.values();
+    std::sort(sorted.begin(), sorted.end(), [](const Job &a, const Job &b) {
+        return a.priority != b.priority ? a.priority > b.priority : a.sequence < b.sequence;
+    });
+    return sorted;
+}
+
+void DeferredJobQueuePrivate::load()
+{
+    if (filePath.isEmpty()) {
+        return;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || doc.object().value(QStringLiteral("version")).toInt() != JOBS_FILE_VERSION) {
+        qCWarning(SOLID_POWER) << "Ignoring invalid deferred jobs file" << filePath << error.errorString();
+        return;
+    }
+
+    // saved in release order, which the sequence numbers carry on
+    Q_FOREACH (const QJsonValue &value, doc.object().value(QStringLiteral("jobs")).toArray()) {
+        const QJsonObject object = value.toObject();
+        Job job;
+        job.id = object.value(QStringLiteral("id")).toString();
+        if (job.id.isEmpty()) {
+            continue;
+        }
+        job.payload = object.value(QStringLiteral("payload")).toObject().toVariantMap();
+        job.conditions.requireAC = object.value(QStringLiteral("requireAC")).toBool(true);
+        job.conditions.avoidPowerSaver = object.value(QStringLiteral("avoidPowerSaver")).toBool(true);
+        job.conditions.minBatteryLevel = object.value(QStringLiteral("minBatteryLevel")).toInt();
+        job.priority = object.value(QStringLiteral("priority")).toInt();
+        job.sequence = nextSequence++;
+        job.running = false;
+        jobs.insert(job.id, job);
+    }
+}
+
+DeferredJobQueuePrivate::~DeferredJobQueuePrivate()
+{
+    // flush what's still waiting for the timer
+    if (saveTimer->isActive()) {
+        save();
+    }
+}
+
+void DeferredJobQueuePrivate::scheduleSave()
+{
+    if (!saveTimer->isActive()) {
+        saveTimer->start();
+    }
+}
+
+void DeferredJobQueuePrivate::save()
+{
+    saveTimer->stop();
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    QJsonArray array;
+    Q_FOREACH (const Job &job, sortedJobs()) {
+        QJsonObject object;
+        object.insert(QStringLiteral("id"), job.id);
+        object.insert(QStringLiteral("payload"), QJsonObject::fromVariantMap(job.payload));
+        object.insert(QStringLiteral("requireAC"), job.conditions.requireAC);
+        object.insert(QStringLiteral("avoidPowerSaver"), job.conditions.avoidPowerSaver);
+        object.insert(QStringLiteral("minBatteryLevel"), job.conditions.minBatteryLevel);
+        object.insert(QStringLiteral("priority"), job.priority);
+        array.append(object);
+    }
+    QJsonObject root;
+    root.insert(QStringLiteral("version"), JOBS_FILE_VERSION);
+    root.insert(QStringLiteral("jobs"), array);
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    // written to a temporary file and renamed, so that a crash never loses the whole queue
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(SOLID_POWER) << "Cannot write deferred jobs" << filePath << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qCWarning(SOLID_POWER) << "Cannot write deferred jobs" << filePath << file.errorString();
+    }
+}
+
+void DeferredJobQueuePrivate::schedule()
+{
+    if (batchTimer->isActive()) {
+        return;
+    }
+    // always from the event loop, never from within the caller's submit() or finish()
+    const qint64 wait = lastBatch.isValid() ? qMax<qint64>(0, batchInterval - lastBatch.elapsed()) : 0;
+    batchTimer->start(int(wait));
+}
+
+void DeferredJobQueuePrivate::powerStateChanged()
+{
+    const bool conserving = Solid::PowerManagement::appShouldConserveResources();
+    const Solid::PowerManagement::PowerProfile profile = Solid::PowerManagement::powerProfile();
+    const int batteryLevel = BatteryLevelMonitor::instance()->level();
+
+    QStringList cancelled;
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (it->running && !conditionsMet(it->conditions, conserving, profile, batteryLevel)) {
+            it->running = false;
+            cancelled << it.key();
+        }
+    }
+    Q_FOREACH (const QString &id, cancelled) {
+        Q_EMIT q->jobCancelled(id);
+    }
+
+    schedule();
+}
+
+void DeferredJobQueuePrivate::releaseBatch()
+{
+    int running = 0;
+    Q_FOREACH (const Job &job, jobs) {
+        if (job.running) {
+            ++running;
+        }
+    }
+    // finish() schedules the next batch
+    if (running >= batchSize) {
+        return;
+    }
+
+    const bool conserving = Solid::PowerManagement::appShouldConserveResources();
+    const Solid::PowerManagement::PowerProfile profile = Solid::PowerManagement::powerProfile();
+    const int batteryLevel = BatteryLevelMonitor::instance()->level();
+
+    QList<Job> eligible;
+    Q_FOREACH (const Job &job, sortedJobs()) {
+        if (!job.running && conditionsMet(job.conditions, conserving, profile, batteryLevel)) {
+            eligible << job;
+        }
+    }
+    if (eligible.isEmpty()) {
+        // the next power state change schedules again
+        return;
+    }
+
+    lastBatch.start();
+    Q_FOREACH (const Job &job, eligible) {
+        if (running >= batchSize) {
+            break;
+        }
+        // the slots connected to jobReady may have changed the queue
+        auto it = jobs.find(job.id);
+        if (it == jobs.end() || it->running || it->sequence != job.sequence) {
+            continue;
+        }
+        it->running = true;
+        ++running;
+        const QVariantMap payload = it->payload;
+        Q_EMIT q->jobReady(job.id, payload);
+    }
+}
+
+Solid::DeferredJobQueue::DeferredJobQueue(const QString &name, QObject *parent)
+    : QObject(parent)
+    , d(new DeferredJobQueuePrivate(this, name))
+{
+}
+
+Solid::DeferredJobQueue::~DeferredJobQueue()
+{
+    // d is our child
+}
+
+void Solid::DeferredJobQueue::submit(const QString &id, const QVariantMap &payload, const PowerConditions &conditions, int priority)
+{
+    auto it = d->jobs.find(id);
+    if (it == d->jobs.end()) {
+        DeferredJobQueuePrivate::Job job;
+        job.id = id;
+        job.sequence = d->nextSequence++;
+        job.running = false;
+        it = d->jobs.insert(id, job);
+    }
+    // a released job keeps running with the new data, finish() completes it
+    it->payload = payload;
+    it->conditions = conditions;
+    it->priority = priority;
+
+    d->scheduleSave();
+    d->schedule();
+}
+
+bool Solid::DeferredJobQueue::cancel(const QString &id)
+{
+    if (!d->jobs.remove(id)) {
+        return false;
+    }
+    d->scheduleSave();
+    d->schedule();
+    return true;
+}
+
+bool Solid::DeferredJobQueue::finish(const QString &id)
+{
+    return cancel(id);
+}
+
+QStringList Solid::DeferredJobQueue::pendingJobs() const
+{
+    QStringList result;
+    Q_FOREACH (const DeferredJobQueuePrivate::Job &job, d->sortedJobs()) {
+        if (!job.running) {
+            result << job.id;
+        }
+    }
+    return result;
+}
+
+QStringList Solid::DeferredJobQueue::runningJobs() const
+{
+    QStringList result;
+    Q_FOREACH (const DeferredJobQueuePrivate::Job &job, d->sortedJobs()) {
+        if (job.running) {
+            result << job.id;
+        }
+    }
+    return result;
+}
+
+int Solid::DeferredJobQueue::batchSize() const
+{
+    return d->batchSize;
+}
+
+void Solid::DeferredJobQueue::setBatchSize(int size)
+{
+    d->batchSize = qMax(1, size);
+    d->schedule();
+}
+
+int Solid::DeferredJobQueue::batchInterval() const
+{
+    return d->batchInterval;
+}
+
+void Solid::DeferredJobQueue::setBatchInterval(int msecs)
+{
+    d->batchInterval = qMax(0, msecs);
+}
+
+bool Solid::DeferredJobQueue::conditionsMet(const PowerConditions &conditions) const
+{
+    return DeferredJobQueuePrivate::conditionsMet(conditions, PowerManagement::appShouldConserveResources(),
+                                                  PowerManagement::powerProfile(), BatteryLevelMonitor::instance()->level());
+}
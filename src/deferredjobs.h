@@ -0,0 +1,155 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <solidpower_export.h>
+
+#ifndef SOLID_DEFERREDJOBS_H
+#define SOLID_DEFERREDJOBS_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+namespace Solid {
+
+class DeferredJobQueuePrivate;
+
+/**
+ * The power conditions a deferred job waits for.
+ *
+ * @since 5.x
+ */
+struct PowerConditions
+{
+    //! Only while running on AC power, i.e. while the app doesn't have to conserve resources
+    bool requireAC = true;
+    //! Not while the power saver profile is active
+    bool avoidPowerSaver = true;
+    //! When running on battery, only above this charge level in percent; 0 for any level
+    int minBatteryLevel = 0;
+};
+
+/**
+ * A persistent queue of background jobs (indexing, backups, thumbnailing, ...)
+ * that only run when the power state allows it.
+ *
+ * Jobs are submitted with their PowerConditions and a priority, and saved to
+ * disk within a second, or when the queue is destroyed. Whenever the conditions of some jobs are met, the queue
+ * releases them through jobReady(), highest priority first, in batches of at
+ * most batchSize() jobs at least batchInterval() apart. The application does
+ * the work and calls finish(). When the conditions of a released job stop
+ * holding, e.g. on switching to battery, jobCancelled() tells the application
+ * to stop working on it, and the job is released again later.
+ *
+ * Jobs that weren't finished are loaded again by the next queue created with
+ * the same name, e.g. after the application restarted.
+ *
+ * @code
+ *   Solid::DeferredJobQueue *queue = new Solid::DeferredJobQueue(QStringLiteral("thumbnails"), this);
+ *   connect(queue, &Solid::DeferredJobQueue::jobReady, this, &Thumbnailer::generate);
+ *   queue->submit(url.toString(), QVariantMap{{QStringLiteral("size"), 256}});
+ * @endcode
+ *
+ * @since 5.x
+ */
+class SOLIDPOWER_EXPORT DeferredJobQueue : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * Creates the queue @p name of the application, loading the jobs it had
+     * left. The name has to be unique within the application; it may contain
+     * any character, it gets escaped for the file name.
+     */
+    explicit DeferredJobQueue(const QString &name, QObject *parent = Q_NULLPTR);
+    ~DeferredJobQueue();
+
+    /**
+     * Queues the job @p id, replacing any pending one with the same id.
+     * @param payload what the job is about; it's saved as JSON, so it must be representable as such
+     * @param conditions the power conditions the job waits for
+     * @param priority jobs with a higher priority are released first
+     */
+    void submit(const QString &id, const QVariantMap &payload,
+                const PowerConditions &conditions = PowerConditions(), int priority = 0);
+
+    /**
+     * Removes the job @p id, whether it's pending or released.
+     * @return false if there's no such job
+     */
+    bool cancel(const QString &id);
+
+    /**
+     * Marks the released job @p id as done, removing it from the queue.
+     * @return false if there's no such job
+     */
+    bool finish(const QString &id);
+
+    /**
+     * @return the ids of the jobs waiting for their conditions or their turn
+     */
+    QStringList pendingJobs() const;
+
+    /**
+     * @return the ids of the jobs released and not finished yet
+     */
+    QStringList runningJobs() const;
+
+    /**
+     * @return the maximum number of jobs released and not finished at once, 4 by default
+     */
+    int batchSize() const;
+    void setBatchSize(int size);
+
+    /**
+     * @return the minimum time between two batches of jobs in milliseconds, 30 seconds by default
+     */
+    int batchInterval() const;
+    void setBatchInterval(int msecs);
+
+    /**
+     * @return whether @p conditions are met by the current power state
+     */
+    bool conditionsMet(const PowerConditions &conditions) const;
+
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the job @p id may run
+     * @param id the job id
+     * @param payload the payload it was submitted with
+     */
+    void jobReady(const QString &id, const QVariantMap &payload);
+
+    /**
+     * This signal is emitted when the conditions of the released job @p id
+     * stopped holding; the application should stop working on it, it will
+     * be released again later.
+     * @param id the job id
+     */
+    void jobCancelled(const QString &id);
+
+private:
+    DeferredJobQueuePrivate *const d;
+};
+
+} // namespace Solid
+
+#endif
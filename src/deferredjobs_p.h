@@ -0,0 +1,109 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_DEFERREDJOBS_P_H
+#define SOLID_DEFERREDJOBS_P_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+
+#include "deferredjobs.h"
+#include "powermanagement.h"
+
+#include <atomic>
+
+class QDBusPendingCallWatcher;
+class QTimer;
+
+/*
+ * The charge level of the system's batteries as a whole, from UPower's
+ * display device; shared by all the queues.
+ */
+class BatteryLevelMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    BatteryLevelMonitor();
+    ~BatteryLevelMonitor();
+
+    static BatteryLevelMonitor *instance();
+
+    // in percent, -1 when unknown (no UPower, no battery)
+    int level() const;
+
+Q_SIGNALS:
+    void levelChanged(int level);
+
+private Q_SLOTS:
+    void fetch();
+    void levelReply(QDBusPendingCallWatcher *watcher);
+    void devicePropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated);
+
+private:
+    void updateLevel(int level);
+
+    std::atomic<int> m_level {-1};
+};
+
+class DeferredJobQueuePrivate : public QObject
+{
+    Q_OBJECT
+public:
+    struct Job {
+        QString id;
+        QVariantMap payload;
+        Solid::PowerConditions conditions;
+        int priority;
+        quint64 sequence; // submission order, within a priority
+        bool running;
+    };
+
+    explicit DeferredJobQueuePrivate(Solid::DeferredJobQueue *q, const QString &name);
+    ~DeferredJobQueuePrivate();
+
+    static bool conditionsMet(const Solid::PowerConditions &conditions, bool conserving,
+                              Solid::PowerManagement::PowerProfile profile, int batteryLevel);
+    QList<Job> sortedJobs() const;
+
+    void load();
+    // coalesces the changes of the next SAVE_DELAY milliseconds into one write
+    void scheduleSave();
+    // releases a batch now, or once the batch interval elapsed
+    void schedule();
+
+public Q_SLOTS:
+    void powerStateChanged();
+    void releaseBatch();
+    void save();
+
+public:
+    Solid::DeferredJobQueue *q;
+    QString filePath;
+    QHash<QString, Job> jobs;
+    quint64 nextSequence = 0;
+    int batchSize = 4;
+    int batchInterval = 30000;
+    QTimer *batchTimer;
+    QElapsedTimer lastBatch;
+    QTimer *saveTimer;
+};
+
+#endif
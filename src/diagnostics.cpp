@@ -0,0 +1,238 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QAbstractEventDispatcher>
+#include <QDBusPendingCallWatcher>
+#include <QGlobalStatic>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+
+#include "diagnostics.h"
+#include "diagnostics_p.h"
+#include "trace_p.h"
+
+namespace
+{
+struct StatsRegistry
+{
+    QMutex mutex;
+    QHash<QString, DiagnosticsPrivate::CallStats *> methods;
+    std::atomic<quint64> signalsReceived;
+    std::atomic<quint64> signalsEmitted;
+
+    StatsRegistry()
+    {
+        signalsReceived = 0;
+        signalsEmitted = 0;
+    }
+
+    // the records are leaked on purpose: threads keep pointers to them, and
+    // may still record into them while the library gets unloaded
+};
+}
+
+Q_GLOBAL_STATIC(StatsRegistry, globalStats)
+
+static int bucketIndex(quint64 usecs)
+{
+    if (usecs < 4) {
+        return usecs;
+    }
+    const int exponent = 63 - __builtin_clzll(usecs); // >= 2
+    const int sub = (usecs >> (exponent - 2)) & 3;
+    return qMin(4 + (exponent - 2) * 4 + sub, DiagnosticsPrivate::HistogramBuckets - 1);
+}
+
+static quint64 bucketUpperBound(int index)
+{
+    if (index < 4) {
+        return index;
+    }
+    const int exponent = (index - 4) / 4 + 2;
+    const int sub = (index - 4) % 4;
+    return ((quint64(4 + sub) << (exponent - 2)) + (quint64(1) << (exponent - 2))) - 1;
+}
+
+DiagnosticsPrivate::CallStats::CallStats(const QString &name):
+    name(name)
+{
+    reset();
+}
+
+void DiagnosticsPrivate::CallStats::record(quint64 usecs, bool failed)
+{
+    calls.fetch_add(1, std::memory_order_relaxed);
+    if (failed) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    buckets[bucketIndex(usecs)].fetch_add(1, std::memory_order_relaxed);
+
+    quint64 currentMax = max.load(std::memory_order_relaxed);
+    while (usecs > currentMax && !max.compare_exchange_weak(currentMax, usecs, std::memory_order_relaxed)) {
+    }
+}
+
+void DiagnosticsPrivate::CallStats::reset()
+{
+    calls = 0;
+    errors = 0;
+    max = 0;
+    for (int i = 0; i < HistogramBuckets; ++i) {
+        buckets[i] = 0;
+    }
+}
+
+DiagnosticsPrivate::CallStats *DiagnosticsPrivate::stats(const QString &service, const QString &method)
+{
+    // keyed by the pair, so a hit neither allocates nor locks
+    static thread_local QHash<QPair<QString, QString>, CallStats *> cache;
+    const QPair<QString, QString> key(service, method);
+    CallStats *&cached = cache[key];
+    if (cached) {
+        return cached;
+    }
+
+    const QString name = service + QLatin1Char(' ') + method;
+    StatsRegistry *registry = globalStats;
+    QMutexLocker locker(&registry->mutex);
+    CallStats *&result = registry->methods[name];
+    if (!result) {
+        result = new CallStats(name);
+    }
+    cached = result;
+    return result;
+}
+
+void DiagnosticsPrivate::signalReceived()
+{
+    globalStats->signalsReceived.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DiagnosticsPrivate::signalEmitted()
+{
+    globalStats->signalsEmitted.fetch_add(1, std::memory_order_relaxed);
+}
+
+DiagnosticsPrivate::CallTimer::CallTimer(const QString &service, const QString &method):
+    m_stats(stats(service, method))
+{
+#if SOLIDPOWER_TRACING
+    if (TracePrivate::enabled()) {
+        m_traceStart = TracePrivate::now();
+    }
+#endif
+    m_timer.start();
+}
+
+DiagnosticsPrivate::CallTimer::~CallTimer()
+{
+    m_stats->record(m_timer.nsecsElapsed() / 1000, m_failed);
+#if SOLIDPOWER_TRACING
+    if (m_traceStart) {
+        TracePrivate::complete("dbus", m_stats->name, m_traceStart);
+    }
+#endif
+}
+
+void DiagnosticsPrivate::CallTimer::setFailed(bool failed)
+{
+    m_failed = failed;
+}
+
+void DiagnosticsPrivate::trackPendingCall(const QString &service, const QString &method, const QDBusPendingCall &call)
+{
+    CallStats *callStats = stats(service, method);
+    if (!QAbstractEventDispatcher::instance()) {
+        callStats->record(0, false);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const qint64 traceStart = TracePrivate::enabled() ? TracePrivate::now() : 0;
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, [callStats, timer, traceStart](QDBusPendingCallWatcher *w) {
+        callStats->record(timer.nsecsElapsed() / 1000, w->isError());
+        if (traceStart) {
+            TracePrivate::complete("dbus", callStats->name, traceStart);
+        }
+        w->deleteLater();
+    });
+}
+
+// public
+QList<Solid::Diagnostics::MethodStatistics> Solid::Diagnostics::methodStatistics()
+{
+    QList<MethodStatistics> result;
+    StatsRegistry *registry = globalStats;
+    QMutexLocker locker(&registry->mutex);
+    for (auto it = registry->methods.constBegin(); it != registry->methods.constEnd(); ++it) {
+        const DiagnosticsPrivate::CallStats *callStats = it.value();
+
+        MethodStatistics ms;
+        ms.method = it.key();
+        ms.calls = callStats->calls.load(std::memory_order_relaxed);
+        ms.errors = callStats->errors.load(std::memory_order_relaxed);
+        ms.max = callStats->max.load(std::memory_order_relaxed);
+
+        quint64 counts[DiagnosticsPrivate::HistogramBuckets];
+        quint64 total = 0;
+        for (int i = 0; i < DiagnosticsPrivate::HistogramBuckets; ++i) {
+            counts[i] = callStats->buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+
+        // walk the histogram until the rank of each percentile is reached
+        const int percentiles[] = { 50, 95, 99 };
+        quint64 *results[] = { &ms.p50, &ms.p95, &ms.p99 };
+        int next = 0;
+        quint64 seen = 0;
+        for (int i = 0; i < DiagnosticsPrivate::HistogramBuckets && total > 0 && next < 3; ++i) {
+            seen += counts[i];
+            while (next < 3 && seen * 100 >= total * percentiles[next]) {
+                *results[next++] = qMin(bucketUpperBound(i), ms.max);
+            }
+        }
+        result << ms;
+    }
+    return result;
+}
+
+quint64 Solid::Diagnostics::signalsReceived()
+{
+    return globalStats->signalsReceived.load(std::memory_order_relaxed);
+}
+
+quint64 Solid::Diagnostics::signalsEmitted()
+{
+    return globalStats->signalsEmitted.load(std::memory_order_relaxed);
+}
+
+void Solid::Diagnostics::resetStatistics()
+{
+    StatsRegistry *registry = globalStats;
+    QMutexLocker locker(&registry->mutex);
+    Q_FOREACH (DiagnosticsPrivate::CallStats *callStats, registry->methods) {
+        callStats->reset();
+    }
+    registry->signalsReceived = 0;
+    registry->signalsEmitted = 0;
+}
@@ -0,0 +1,89 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <solidpower_export.h>
+
+#ifndef SOLID_DIAGNOSTICS_H
+#define SOLID_DIAGNOSTICS_H
+
+#include <QList>
+#include <QString>
+
+namespace Solid {
+
+/**
+ * This namespace provides runtime statistics about the library's communication
+ * with the system services (logind, UPower, hostname1, HAL, ...).
+ *
+ * The statistics are always collected; recording a call costs a few atomic
+ * increments, so they can be left on in production and queried when users
+ * report stalls, e.g. to find out which system daemon is slow to respond.
+ */
+namespace Diagnostics {
+
+/**
+ * Statistics of a single remote method, e.g. "org.freedesktop.login1 CanSuspend".
+ *
+ * The latencies are in microseconds and are approximated by a log-bucketed
+ * histogram, with an error of at most 25%.
+ */
+struct MethodStatistics
+{
+    //! Service and method (and property name for property reads) of the remote call
+    QString method;
+    //! Number of calls made
+    quint64 calls = 0;
+    //! Number of calls that returned an error or timed out
+    quint64 errors = 0;
+    //! Median latency
+    quint64 p50 = 0;
+    //! 95th percentile latency
+    quint64 p95 = 0;
+    //! 99th percentile latency
+    quint64 p99 = 0;
+    //! Highest latency seen
+    quint64 max = 0;
+};
+
+/**
+  * @return the statistics of all remote methods called so far
+  */
+SOLIDPOWER_EXPORT QList<MethodStatistics> methodStatistics();
+
+/**
+  * @return the number of D-Bus signals received from the system services
+  */
+SOLIDPOWER_EXPORT quint64 signalsReceived();
+
+/**
+  * @return the number of Notifier signals emitted to the application
+  */
+SOLIDPOWER_EXPORT quint64 signalsEmitted();
+
+/**
+  * Resets all the statistics to zero.
+  */
+SOLIDPOWER_EXPORT void resetStatistics();
+
+} // namespace Diagnostics
+
+} // namespace Solid
+
+#endif
@@ -0,0 +1,102 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_DIAGNOSTICS_P_H
+#define SOLID_DIAGNOSTICS_P_H
+
+#include <QDBusPendingCall>
+#include <QElapsedTimer>
+#include <QString>
+
+#include <atomic>
+
+#include "diagnostics.h"
+#include "trace_p.h"
+
+namespace DiagnosticsPrivate
+{
+// latency histogram: exact below 4us, then 4 buckets per power of two
+const int HistogramBuckets = 160;
+
+struct CallStats
+{
+    const QString name; // "service method"
+    std::atomic<quint64> calls;
+    std::atomic<quint64> errors;
+    std::atomic<quint64> max;
+    std::atomic<quint64> buckets[HistogramBuckets];
+
+    explicit CallStats(const QString &name);
+    void record(quint64 usecs, bool failed);
+    void reset();
+};
+
+/*
+ * Returns the (never deleted) statistics of the given method. Each thread
+ * keeps the pointers it looked up, so only the first lookup of a method in
+ * a thread builds its name and takes the registry mutex.
+ */
+CallStats *stats(const QString &service, const QString &method);
+
+void signalReceived();
+void signalEmitted();
+
+/*
+ * Emits a signal, counting it and tracing its receivers:
+ *
+ *   SOLID_EMIT_SIGNAL("shuttingDown", shuttingDown());
+ */
+#define SOLID_EMIT_SIGNAL(name, emission) \
+    do { \
+        DiagnosticsPrivate::signalEmitted(); \
+        SOLID_TRACE_SCOPE("signal", QStringLiteral(name)); \
+        Q_EMIT emission; \
+    } while (0)
+
+/*
+ * Records the latency of a blocking call, from construction to destruction:
+ *
+ *   DiagnosticsPrivate::CallTimer timer(LOGIN1_SERVICE, method);
+ *   QDBusReply<QString> reply = ...;
+ *   timer.setFailed(!reply.isValid());
+ */
+class CallTimer
+{
+public:
+    CallTimer(const QString &service, const QString &method);
+    ~CallTimer();
+
+    void setFailed(bool failed = true);
+
+private:
+    CallStats *m_stats;
+    QElapsedTimer m_timer;
+    bool m_failed = false;
+    qint64 m_traceStart = 0; // only set while tracing
+};
+
+/*
+ * Records the latency of an asynchronous call once its reply arrives; needs
+ * an event loop in the calling thread, otherwise only the call is counted.
+ */
+void trackPendingCall(const QString &service, const QString &method, const QDBusPendingCall &call);
+}
+
+#endif
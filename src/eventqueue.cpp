@@ -0,0 +1,160 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QGlobalStatic>
+#include <QLoggingCategory>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <sys/eventfd.h>
+#endif
+
+#include "eventqueue_p.h"
+#include "powerstate_p.h"
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+using namespace Solid::PowerManagement;
+
+Q_GLOBAL_STATIC(EventQueue, globalEventQueue)
+
+EventQueue::EventQueue()
+{
+#ifdef Q_OS_LINUX
+    m_readFd = m_writeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int fd : fds) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+        }
+        m_readFd = fds[0];
+        m_writeFd = fds[1];
+    }
+#endif
+    if (m_readFd == -1) {
+        qCWarning(SOLID_POWER) << "Cannot create the event descriptor:" << strerror(errno);
+        return;
+    }
+
+    // the queue is filled from the thread emitting the signals, no event loop needed on our side
+    Notifier *notifier = Solid::PowerManagement::notifier();
+    connect(notifier, &Notifier::appShouldConserveResourcesChanged, this, [this]() {
+        enqueue(Event::ConserveResourcesChangedEvent);
+    }, Qt::DirectConnection);
+    connect(notifier, &Notifier::resumingFromSuspend, this, [this]() {
+        enqueue(Event::ResumingFromSuspendEvent);
+    }, Qt::DirectConnection);
+    connect(notifier, &Notifier::aboutToSuspend, this, [this]() {
+        enqueue(Event::AboutToSuspendEvent);
+    }, Qt::DirectConnection);
+    connect(notifier, &Notifier::shuttingDown, this, [this]() {
+        enqueue(Event::ShuttingDownEvent);
+    }, Qt::DirectConnection);
+    connect(notifier, &Notifier::isLidClosedChanged, this, [this]() {
+        enqueue(Event::LidClosedChangedEvent);
+    }, Qt::DirectConnection);
+    connect(notifier, &Notifier::powerProfileChanged, this, [this]() {
+        enqueue(Event::PowerProfileChangedEvent);
+    }, Qt::DirectConnection);
+}
+
+EventQueue::~EventQueue()
+{
+    if (m_writeFd != -1 && m_writeFd != m_readFd) {
+        close(m_writeFd);
+    }
+    if (m_readFd != -1) {
+        close(m_readFd);
+    }
+}
+
+EventQueue *EventQueue::instance()
+{
+    return globalEventQueue;
+}
+
+int EventQueue::fd() const
+{
+    return m_readFd;
+}
+
+void EventQueue::enqueue(Event::Type type)
+{
+    const Event event = {type, PowerStatePrivate::snapshot()};
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&m_mutex);
+        wasEmpty = m_events.isEmpty();
+        m_events.append(event);
+    }
+
+    // the descriptor stays readable until dispatch(), once is enough
+    if (wasEmpty) {
+#ifdef Q_OS_LINUX
+        const quint64 one = 1;
+#else
+        const char one = 1;
+#endif
+        if (write(m_writeFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+            qCWarning(SOLID_POWER) << "Cannot signal the pending events:" << strerror(errno);
+        }
+    }
+}
+
+int EventQueue::dispatch(const std::function<void(const Event &event)> &handler)
+{
+    QVector<Event> events;
+    {
+        QMutexLocker locker(&m_mutex);
+        events.swap(m_events);
+        // drain under the lock, so that a concurrent enqueue() can't get its wakeup eaten
+        char buffer[64];
+        while (read(m_readFd, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+
+    for (const Event &event : events) {
+        handler(event);
+    }
+    return events.count();
+}
+
+int Solid::PowerManagement::eventFd()
+{
+    // QtDBus can't be driven from a foreign descriptor, its connection needs a Qt event
+    // dispatcher: the bus gets processed on the private I/O thread, which runs one
+    setUseIoThread(true);
+    return globalEventQueue->fd();
+}
+
+int Solid::PowerManagement::dispatchEvents(const std::function<void(const Event &event)> &handler)
+{
+    if (!globalEventQueue.exists()) {
+        return 0;
+    }
+    return globalEventQueue->dispatch(handler);
+}
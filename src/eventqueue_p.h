@@ -0,0 +1,57 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_EVENTQUEUE_P_H
+#define SOLID_POWER_EVENTQUEUE_P_H
+
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+#include "powermanagement.h"
+
+/*
+ * Queues the Notifier signals for dispatchEvents(), for applications running
+ * an event loop other than Qt's. Created in, and owned by, the thread calling
+ * eventFd(); the signals get queued right away from the I/O thread emitting
+ * them, through direct connections.
+ */
+class EventQueue : public QObject
+{
+    Q_OBJECT
+public:
+    EventQueue();
+    ~EventQueue();
+
+    static EventQueue *instance();
+
+    int fd() const;
+    int dispatch(const std::function<void(const Solid::PowerManagement::Event &event)> &handler);
+
+private:
+    void enqueue(Solid::PowerManagement::Event::Type type);
+
+    int m_readFd = -1;
+    int m_writeFd = -1; // the same as m_readFd for an eventfd
+    QMutex m_mutex;
+    QVector<Solid::PowerManagement::Event> m_events;
+};
+
+#endif
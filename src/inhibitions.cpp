@@ -20,101 +20,349 @@
 */
 
 #include <QCoreApplication>
-#include <QDBusMessage>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDBusReply>
+#include <QDBusServiceWatcher>
 
 #include "powermanagement.h"
 #include "inhibitions_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
+
+#include <limits>
+
+#define SCREENSAVER_SERVICE QStringLiteral("org.freedesktop.ScreenSaver")
+
+namespace
+{
+struct ProviderInfo {
+    const char *service; // also the interface name
+    const char *path;
+    const char *acquireMethod;
+    const char *releaseMethod;
+    bool screenSettings; // whether it can keep the screen on, not just the session up
+};
+
+// indexed by InhibitionsPrivate::Provider
+const ProviderInfo providers[InhibitionsPrivate::ProviderCount] = {
+    { "org.kde.Solid.PowerManagement.PolicyAgent", "/org/kde/Solid/PowerManagement/PolicyAgent",
+      "AddInhibition", "ReleaseInhibition", true },
+    { "org.freedesktop.PowerManagement.Inhibit", "/org/freedesktop/PowerManagement/Inhibit",
+      "Inhibit", "UnInhibit", false }
+};
+
+QString providerService(InhibitionsPrivate::Provider provider)
+{
+    return QString::fromLatin1(providers[provider].service);
+}
+}
 
 Q_GLOBAL_STATIC(InhibitionsPrivate, globalInhibitions)
 
-InhibitionsPrivate::InhibitionsPrivate():
-    policyAgentIface(QStringLiteral("org.kde.Solid.PowerManagement.PolicyAgent"),
-                     QStringLiteral("/org/kde/Solid/PowerManagement/PolicyAgent"),
-                     QDBusConnection::sessionBus()),
-    inhibitIface(QStringLiteral("org.freedesktop.PowerManagement.Inhibit"),
-                 QStringLiteral("/org/freedesktop/PowerManagement/Inhibit"),
-                 QDBusConnection::sessionBus())
+InhibitionsPrivate::InhibitionsPrivate()
 {
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    m_watcher = new QDBusServiceWatcher(this);
+    m_watcher->setConnection(bus);
+    m_watcher->setWatchMode(QDBusServiceWatcher::WatchForOwnerChange);
+    for (int p = 0; p < ProviderCount; ++p) {
+        m_watcher->addWatchedService(providerService(Provider(p)));
+    }
+    connect(m_watcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &InhibitionsPrivate::serviceOwnerChanged);
+
+    // we might be created from any thread, live in the library's one; the watcher moves along
+    IoThread::adopt(this);
+
+    // initial routing, the watcher keeps it up to date from now on
+    if (QDBusConnectionInterface *iface = bus.interface()) {
+        for (int p = 0; p < ProviderCount; ++p) {
+            const QDBusReply<QString> owner = iface->serviceOwner(providerService(Provider(p)));
+            if (owner.isValid()) {
+                m_owners[p] = owner.value();
+            }
+        }
+    }
 }
 
 InhibitionsPrivate::~InhibitionsPrivate()
 {
 }
 
-int Solid::PowerManagement::beginSuppressingSleep(const QString &reason)
+InhibitionsPrivate::Provider InhibitionsPrivate::bestProvider(RequiredPolicy policy) const
 {
-    QDBusReply<uint> reply;
-    if (globalInhibitions->policyAgentIface.isValid()) {
-        reply = globalInhibitions->policyAgentIface.AddInhibition(
-                    (uint)InhibitionsPrivate::InterruptSession,
-                    QCoreApplication::applicationName(), reason);
-    } else {
-        // Fallback to the fd.o Inhibit interface
-        reply = globalInhibitions->inhibitIface.Inhibit(QCoreApplication::applicationName(), reason);
+    for (int p = 0; p < ProviderCount; ++p) {
+        if (m_owners[p].isEmpty()) {
+            continue;
+        }
+        if (policy == ChangeScreenSettings && !providers[p].screenSettings) {
+            continue;
+        }
+        return Provider(p);
     }
+    return NoProvider;
+}
 
-    if (reply.isValid()) {
-        return reply;
-    } else {
+QDBusMessage InhibitionsPrivate::acquireMessage(Provider provider, const QString &owner, const Inhibition &inhibition)
+{
+    // addressed to the owner itself, so that the cookie is known to come from that very instance
+    QDBusMessage msg = QDBusMessage::createMethodCall(owner, QString::fromLatin1(providers[provider].path),
+                                                      providerService(provider),
+                                                      QString::fromLatin1(providers[provider].acquireMethod));
+    if (provider == PolicyAgentProvider) {
+        msg << (uint)inhibition.policy;
+    }
+    msg << inhibition.application << inhibition.reason;
+    return msg;
+}
+
+QDBusMessage InhibitionsPrivate::releaseMessage(Provider provider, const QString &owner, uint providerCookie)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(owner, QString::fromLatin1(providers[provider].path),
+                                                      providerService(provider),
+                                                      QString::fromLatin1(providers[provider].releaseMethod));
+    msg << providerCookie;
+    return msg;
+}
+
+int InhibitionsPrivate::timeout(Provider provider)
+{
+    return ServiceHealth::forService(providerService(provider), QDBusConnection::SessionBus)->timeout();
+}
+
+int InhibitionsPrivate::begin(RequiredPolicy policy, const QString &reason)
+{
+    Inhibition inhibition;
+    inhibition.policy = policy;
+    inhibition.application = QCoreApplication::applicationName();
+    inhibition.reason = reason;
+    inhibition.status = Inhibition::Acquired;
+    inhibition.providerCookie = 0;
+    inhibition.generation = 0;
+    inhibition.hasScreensaverCookie = false;
+    inhibition.screensaverCookie = 0;
+
+    QMutexLocker locker(&m_mutex);
+    inhibition.provider = bestProvider(policy);
+    if (inhibition.provider == NoProvider) {
+        return -1;
+    }
+    inhibition.owner = m_owners[inhibition.provider];
+    // not held across the call, the routing table has to stay up to date meanwhile
+    locker.unlock();
+
+    const QDBusMessage msg = acquireMessage(inhibition.provider, inhibition.owner, inhibition);
+    DiagnosticsPrivate::CallTimer timer(providerService(inhibition.provider), msg.member());
+    const QDBusReply<uint> reply = QDBusConnection::sessionBus().asyncCall(msg, timeout(inhibition.provider));
+    timer.setFailed(!reply.isValid());
+    if (!reply.isValid()) {
         return -1;
     }
+    inhibition.providerCookie = reply.value();
+
+    locker.relock();
+    int cookie;
+    do {
+        cookie = m_nextCookie;
+        m_nextCookie = m_nextCookie == std::numeric_limits<int>::max() ? 1 : m_nextCookie + 1;
+    } while (m_inhibitions.contains(cookie));
+    m_inhibitions.insert(cookie, inhibition);
+
+    // the routing changed during the call, after serviceOwnerChanged() had a look at the table
+    if (bestProvider(policy) != inhibition.provider || m_owners[inhibition.provider] != inhibition.owner) {
+        QMetaObject::invokeMethod(this, "reconcile", Qt::QueuedConnection);
+    }
+
+    return cookie;
 }
 
-bool Solid::PowerManagement::stopSuppressingSleep(int cookie)
+bool InhibitionsPrivate::stop(int cookie, RequiredPolicy policy)
 {
-    if (globalInhibitions->policyAgentIface.isValid()) {
-        return globalInhibitions->policyAgentIface.ReleaseInhibition(cookie).isValid();
-    } else {
-        // Fallback to the fd.o Inhibit interface
-        return globalInhibitions->inhibitIface.UnInhibit(cookie).isValid();
+    QMutexLocker locker(&m_mutex);
+    auto it = m_inhibitions.find(cookie);
+    if (it == m_inhibitions.end() || it->policy != policy) {
+        return false;
+    }
+    const Inhibition inhibition = it.value();
+    m_inhibitions.erase(it);
+
+    // a re-acquisition in flight gets released on reply, a provider gone away took its inhibitions along
+    if (inhibition.status != Inhibition::Acquired || m_owners[inhibition.provider] != inhibition.owner) {
+        return true;
     }
+    locker.unlock();
+
+    const QDBusMessage msg = releaseMessage(inhibition.provider, inhibition.owner, inhibition.providerCookie);
+    DiagnosticsPrivate::CallTimer timer(providerService(inhibition.provider), msg.member());
+    const bool result = QDBusReply<void>(QDBusConnection::sessionBus().asyncCall(msg, timeout(inhibition.provider))).isValid();
+    timer.setFailed(!result);
+    return result;
 }
 
-int Solid::PowerManagement::beginSuppressingScreenPowerManagement(const QString &reason)
+void InhibitionsPrivate::setScreensaverCookie(int cookie, uint screensaverCookie)
 {
-    if (globalInhibitions->policyAgentIface.isValid()) {
-        QDBusReply<uint> reply = globalInhibitions->policyAgentIface.AddInhibition(
-                    (uint)InhibitionsPrivate::ChangeScreenSettings,
-                    QCoreApplication::applicationName(), reason);
+    QMutexLocker locker(&m_mutex);
+    auto it = m_inhibitions.find(cookie);
+    if (it != m_inhibitions.end()) {
+        it->hasScreensaverCookie = true;
+        it->screensaverCookie = screensaverCookie;
+    }
+}
 
-        if (reply.isValid()) {
-            QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.ScreenSaver"), QStringLiteral("/ScreenSaver"),
-                                                                  QStringLiteral("org.freedesktop.ScreenSaver"), QStringLiteral("Inhibit"));
-            message << QCoreApplication::applicationName();
-            message << reason;
+bool InhibitionsPrivate::takeScreensaverCookie(int cookie, uint *screensaverCookie)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_inhibitions.find(cookie);
+    if (it == m_inhibitions.end() || !it->hasScreensaverCookie) {
+        return false;
+    }
+    it->hasScreensaverCookie = false;
+    *screensaverCookie = it->screensaverCookie;
+    return true;
+}
 
-            QDBusReply<uint> ssReply = QDBusConnection::sessionBus().asyncCall(message);
-            if (ssReply.isValid()) {
-                globalInhibitions->screensaverCookiesForPowerDevilCookies.insert(reply, ssReply.value());
+void InhibitionsPrivate::serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+{
+    qCDebug(SOLID_POWER) << "Inhibition provider" << service << "owner changed from" << oldOwner << "to" << newOwner;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int p = 0; p < ProviderCount; ++p) {
+            if (service == providerService(Provider(p))) {
+                m_owners[p] = newOwner;
             }
+        }
+    }
+    reconcile();
+}
 
-            return reply;
-        } else {
-            return -1;
+void InhibitionsPrivate::reconcile()
+{
+    SOLID_TRACE_SCOPE("inhibition", QStringLiteral("reconcile"));
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_inhibitions.begin(); it != m_inhibitions.end(); ++it) {
+        Inhibition &inhibition = it.value();
+        const Provider best = bestProvider(inhibition.policy);
+        if (inhibition.status != Inhibition::Lost && best != NoProvider
+                && inhibition.provider == best && inhibition.owner == m_owners[best]) {
+            continue;
         }
-    } else {
-        // No way to fallback on something, hence return failure
-        return -1;
+
+        // give the old one back, unless its provider instance is gone and took it along
+        if (inhibition.status == Inhibition::Acquired && m_owners[inhibition.provider] == inhibition.owner) {
+            const QDBusMessage msg = releaseMessage(inhibition.provider, inhibition.owner, inhibition.providerCookie);
+            DiagnosticsPrivate::trackPendingCall(providerService(inhibition.provider), msg.member(),
+                                                 QDBusConnection::sessionBus().asyncCall(msg, timeout(inhibition.provider)));
+        }
+
+        ++inhibition.generation;
+        if (best == NoProvider) {
+            qCWarning(SOLID_POWER) << "No provider left for inhibition" << it.key() << "- waiting for one to show up";
+            inhibition.status = Inhibition::Lost;
+            inhibition.provider = NoProvider;
+            inhibition.owner.clear();
+            continue;
+        }
+
+        inhibition.status = Inhibition::Pending;
+        inhibition.provider = best;
+        inhibition.owner = m_owners[best];
+
+        const QDBusMessage msg = acquireMessage(best, inhibition.owner, inhibition);
+        const QDBusPendingCall call = QDBusConnection::sessionBus().asyncCall(msg, timeout(best));
+        DiagnosticsPrivate::trackPendingCall(providerService(best), msg.member(), call);
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+        watcher->setProperty("cookie", it.key());
+        watcher->setProperty("generation", inhibition.generation);
+        watcher->setProperty("provider", int(best));
+        watcher->setProperty("owner", inhibition.owner);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, &InhibitionsPrivate::acquireFinished);
     }
 }
 
-bool Solid::PowerManagement::stopSuppressingScreenPowerManagement(int cookie)
+void InhibitionsPrivate::acquireFinished(QDBusPendingCallWatcher *watcher)
 {
-    if (globalInhibitions->policyAgentIface.isValid()) {
-        bool result = globalInhibitions->policyAgentIface.ReleaseInhibition(cookie).isValid();
+    watcher->deleteLater();
+    const QDBusPendingReply<uint> reply = *watcher;
+    const int cookie = watcher->property("cookie").toInt();
+    const quint64 generation = watcher->property("generation").toULongLong();
+    const Provider provider = Provider(watcher->property("provider").toInt());
+    const QString owner = watcher->property("owner").toString();
 
-        if (globalInhibitions->screensaverCookiesForPowerDevilCookies.contains(cookie)) {
-            QDBusMessage message = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.ScreenSaver"), QStringLiteral("/ScreenSaver"),
-                                                                  QStringLiteral("org.freedesktop.ScreenSaver"), QStringLiteral("UnInhibit"));
-            message << globalInhibitions->screensaverCookiesForPowerDevilCookies.take(cookie);
-            QDBusConnection::sessionBus().asyncCall(message);
+    QMutexLocker locker(&m_mutex);
+    auto it = m_inhibitions.find(cookie);
+    if (it == m_inhibitions.end() || it->generation != generation) {
+        // released or re-routed meanwhile, don't leak what we just got
+        if (!reply.isError()) {
+            const QDBusMessage msg = releaseMessage(provider, owner, reply.value());
+            DiagnosticsPrivate::trackPendingCall(providerService(provider), msg.member(),
+                                                 QDBusConnection::sessionBus().asyncCall(msg, timeout(provider)));
         }
+        return;
+    }
 
-        return result;
-    } else {
-        // No way to fallback on something, hence return failure
-        return false;
+    if (reply.isError()) {
+        qCWarning(SOLID_POWER) << "Failed to re-acquire inhibition" << cookie << "from" << providerService(provider)
+                               << reply.error().message();
+        it->status = Inhibition::Lost;
+        return;
     }
+
+    qCDebug(SOLID_POWER) << "Inhibition" << cookie << "re-acquired from" << providerService(provider);
+    it->status = Inhibition::Acquired;
+    it->providerCookie = reply.value();
 }
 
+int Solid::PowerManagement::beginSuppressingSleep(const QString &reason)
+{
+    SOLID_TRACE_SCOPE("inhibition", QStringLiteral("beginSuppressingSleep"));
+    return globalInhibitions->begin(InhibitionsPrivate::InterruptSession, reason);
+}
+
+bool Solid::PowerManagement::stopSuppressingSleep(int cookie)
+{
+    SOLID_TRACE_SCOPE("inhibition", QStringLiteral("stopSuppressingSleep"));
+    return globalInhibitions->stop(cookie, InhibitionsPrivate::InterruptSession);
+}
+
+int Solid::PowerManagement::beginSuppressingScreenPowerManagement(const QString &reason)
+{
+    SOLID_TRACE_SCOPE("inhibition", QStringLiteral("beginSuppressingScreenPowerManagement"));
+    // only the PolicyAgent routes these, there's nothing to fall back on
+    const int cookie = globalInhibitions->begin(InhibitionsPrivate::ChangeScreenSettings, reason);
+    if (cookie < 0) {
+        return -1;
+    }
+
+    QDBusMessage message = QDBusMessage::createMethodCall(SCREENSAVER_SERVICE, QStringLiteral("/ScreenSaver"),
+                                                          SCREENSAVER_SERVICE, QStringLiteral("Inhibit"));
+    message << QCoreApplication::applicationName();
+    message << reason;
+
+    DiagnosticsPrivate::CallTimer ssTimer(SCREENSAVER_SERVICE, QStringLiteral("Inhibit"));
+    QDBusReply<uint> ssReply = QDBusConnection::sessionBus().asyncCall(message, ServiceHealth::forService(SCREENSAVER_SERVICE, QDBusConnection::SessionBus)->timeout());
+    ssTimer.setFailed(!ssReply.isValid());
+    if (ssReply.isValid()) {
+        globalInhibitions->setScreensaverCookie(cookie, ssReply.value());
+    }
+
+    return cookie;
+}
+
+bool Solid::PowerManagement::stopSuppressingScreenPowerManagement(int cookie)
+{
+    SOLID_TRACE_SCOPE("inhibition", QStringLiteral("stopSuppressingScreenPowerManagement"));
+    uint screensaverCookie;
+    if (globalInhibitions->takeScreensaverCookie(cookie, &screensaverCookie)) {
+        QDBusMessage message = QDBusMessage::createMethodCall(SCREENSAVER_SERVICE, QStringLiteral("/ScreenSaver"),
+                                                              SCREENSAVER_SERVICE, QStringLiteral("UnInhibit"));
+        message << screensaverCookie;
+        DiagnosticsPrivate::trackPendingCall(SCREENSAVER_SERVICE, QStringLiteral("UnInhibit"), QDBusConnection::sessionBus().asyncCall(message));
+    }
+
+    return globalInhibitions->stop(cookie, InhibitionsPrivate::ChangeScreenSettings);
+}
@@ -17,15 +17,33 @@
 
     You should have received a copy of the GNU Lesser General Public
     License along with this library. If not, see <http://www.gnu.org/licenses/>.
-*/
 
+#ifndef SOLID_POWER_INHIBITIONS_P_H
+#define SOLID_POWER_INHIBITIONS_P_H
+
+#include <QDBusMessage>
 #include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QObject>
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
 
-#include "inhibitinterface.h"
-#include "policyagentinterface.h"
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
 
-class InhibitionsPrivate
+/*
+ * Routes inhibitions to the best provider on the session bus, PowerDevil's
+ * PolicyAgent or else the fd.o Inhibit service, following their owners with a
+ * service watcher instead of checking on each call.
+ *
+ * Callers get cookies of our own, which stay valid when the provider changes
+ * (PowerDevil starting late or restarting): the outstanding inhibitions are
+ * then re-acquired from the new provider and re-keyed behind the scenes.
+ */
+class InhibitionsPrivate : public QObject
 {
+    Q_OBJECT
 public:
     enum RequiredPolicy {
         None = 0,
@@ -34,11 +52,62 @@ public:
         ChangeScreenSettings = 4
     };
 
+    // by order of preference
+    enum Provider {
+        NoProvider = -1,
+        PolicyAgentProvider = 0,
+        InhibitProvider,
+        ProviderCount
+    };
+
     InhibitionsPrivate();
     ~InhibitionsPrivate();
 
-public:
-    OrgKdeSolidPowerManagementPolicyAgentInterface policyAgentIface;
-    OrgFreedesktopPowerManagementInhibitInterface inhibitIface;
-    QHash<uint, uint> screensaverCookiesForPowerDevilCookies;
+    // returns our cookie, or -1 when no provider took the inhibition
+    int begin(RequiredPolicy policy, const QString &reason);
+    bool stop(int cookie, RequiredPolicy policy);
+
+    void setScreensaverCookie(int cookie, uint screensaverCookie);
+    bool takeScreensaverCookie(int cookie, uint *screensaverCookie);
+
+public Q_SLOTS:
+    // brings the outstanding inhibitions in line with the routing table
+    void reconcile();
+
+private Q_SLOTS:
+    void serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+    void acquireFinished(QDBusPendingCallWatcher *watcher);
+
+private:
+    struct Inhibition {
+        enum Status {
+            Lost, // no provider holds it, waiting for one to show up
+            Pending, // being re-acquired
+            Acquired
+        };
+
+        RequiredPolicy policy;
+        QString application;
+        QString reason;
+        Status status;
+        Provider provider;
+        QString owner; // unique name of the provider instance holding it
+        uint providerCookie;
+        quint64 generation; // drops the replies of superseded re-acquisitions
+        bool hasScreensaverCookie;
+        uint screensaverCookie;
+    };
+
+    Provider bestProvider(RequiredPolicy policy) const;
+    static QDBusMessage acquireMessage(Provider provider, const QString &owner, const Inhibition &inhibition);
+    static QDBusMessage releaseMessage(Provider provider, const QString &owner, uint providerCookie);
+    static int timeout(Provider provider);
+
+    QDBusServiceWatcher *m_watcher;
+    QMutex m_mutex;
+    QString m_owners[ProviderCount]; // the routing table
+    QHash<int, Inhibition> m_inhibitions;
+    int m_nextCookie = 1;
 };
+
+#endif
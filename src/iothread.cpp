@@ -0,0 +1,107 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QGlobalStatic>
+#include <QMutex>
+#include <QThread>
+
+#include "powermanagement.h"
+#include "iothread_p.h"
+
+static QAtomicInt s_useIoThread(-1); // -1: not decided yet
+
+class IoThreadHolder
+{
+public:
+    IoThreadHolder()
+    {
+        thread.setObjectName(QStringLiteral("solid-power-io"));
+        thread.start();
+        // don't outlive the application, the objects in the thread still use it
+        qAddPostRoutine(IoThread::shutdown);
+    }
+
+    ~IoThreadHolder()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        {
+            QMutexLocker locker(&mutex);
+            if (stopped) {
+                return;
+            }
+            stopped = true;
+        }
+        thread.quit();
+        thread.wait();
+    }
+
+    QThread thread;
+    QMutex mutex;
+    bool stopped = false;
+};
+
+Q_GLOBAL_STATIC(IoThreadHolder, globalIoThread)
+
+void Solid::PowerManagement::setUseIoThread(bool enable)
+{
+    s_useIoThread.testAndSetOrdered(-1, enable ? 1 : 0);
+}
+
+bool IoThread::isEnabled()
+{
+    if (s_useIoThread.load() == -1) {
+        s_useIoThread.testAndSetOrdered(-1, qgetenv("SOLID_POWER_IO_THREAD") == "1" ? 1 : 0);
+    }
+    return s_useIoThread.load() == 1;
+}
+
+QThread *IoThread::home()
+{
+    if (!isEnabled()) {
+        return QCoreApplication::instance() ? QCoreApplication::instance()->thread() : Q_NULLPTR;
+    }
+
+    IoThreadHolder *holder = globalIoThread;
+    if (!holder) {
+        return Q_NULLPTR;
+    }
+    QMutexLocker locker(&holder->mutex);
+    return holder->stopped ? Q_NULLPTR : &holder->thread;
+}
+
+void IoThread::adopt(QObject *object)
+{
+    if (QThread *thread = home()) {
+        object->moveToThread(thread);
+    }
+}
+
+void IoThread::shutdown()
+{
+    if (globalIoThread.exists() && !globalIoThread.isDestroyed()) {
+        globalIoThread->stop();
+    }
+}
@@ -0,0 +1,52 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_IOTHREAD_P_H
+#define SOLID_POWER_IOTHREAD_P_H
+
+class QObject;
+class QThread;
+
+namespace IoThread
+{
+/*
+ * Whether the library processes its bus signals on a private I/O thread, see
+ * Solid::PowerManagement::setUseIoThread() and SOLID_POWER_IO_THREAD.
+ */
+bool isEnabled();
+
+/*
+ * The thread the library's objects live in: the I/O thread when enabled, the
+ * main one otherwise. Starts the I/O thread on first use; null when enabled
+ * but already shut down, or when there's no application object yet.
+ */
+QThread *home();
+
+/*
+ * Moves @p object to home(), where its slots and timers run. Children have to
+ * be created before, they move along with their parent.
+ */
+void adopt(QObject *object);
+
+// stops the I/O thread, waiting for the event being processed to finish
+void shutdown();
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QMetaMethod>
+
+#include "powermanagement.h"
+#include "powerprofiles_p.h"
+#include "powerstate_p.h"
+#include "thermal_p.h"
+#include "diagnostics_p.h"
+
+using namespace Solid::PowerManagement;
+
+// common Notifier code, shared by all the backends
+
+Solid::PowerManagement::Notifier::Notifier()
+{
+    qRegisterMetaType<Solid::PowerManagement::PowerState>("Solid::PowerManagement::PowerState");
+    qRegisterMetaType<Solid::PowerManagement::ChangedFlags>("Solid::PowerManagement::ChangedFlags");
+}
+
+void Solid::PowerManagement::Notifier::connectNotify(const QMetaMethod &signal)
+{
+    // these are tracked lazily, only once somebody is interested in them
+    const bool wantsEverything = signal == QMetaMethod::fromSignal(&Notifier::stateChanged);
+    if (wantsEverything || signal == QMetaMethod::fromSignal(&Notifier::powerProfileChanged)) {
+        PowerProfilesPrivate::instance();
+    }
+    if (wantsEverything || signal == QMetaMethod::fromSignal(&Notifier::thermalPressureChanged)) {
+        QMetaObject::invokeMethod(ThermalMonitor::instance(), "setMonitoring", Q_ARG(bool, true));
+    }
+}
+
+void Solid::PowerManagement::Notifier::disconnectNotify(const QMetaMethod &signal)
+{
+    // an invalid method means everything got disconnected at once
+    const QMetaMethod thermalSignal = QMetaMethod::fromSignal(&Notifier::thermalPressureChanged);
+    const QMetaMethod stateSignal = QMetaMethod::fromSignal(&Notifier::stateChanged);
+    if ((!signal.isValid() || signal == thermalSignal || signal == stateSignal) && ThermalMonitor::exists() &&
+            !isSignalConnected(thermalSignal) && !isSignalConnected(stateSignal)) {
+        QMetaObject::invokeMethod(ThermalMonitor::instance(), "setMonitoring", Q_ARG(bool, false));
+    }
+}
+
+// PowerState
+
+PowerState::PowerState():
+    d(new PowerStatePrivate)
+{
+}
+
+PowerState::PowerState(PowerStatePrivate *dd):
+    d(dd)
+{
+}
+
+PowerState::PowerState(const PowerState &other) = default;
+
+PowerState::~PowerState() = default;
+
+PowerState &PowerState::operator=(const PowerState &other) = default;
+
+bool PowerState::appShouldConserveResources() const
+{
+    return d->conserveResources;
+}
+
+bool PowerState::hasLid() const
+{
+    return d->hasLid;
+}
+
+bool PowerState::isLidClosed() const
+{
+    return d->lidClosed;
+}
+
+PowerProfile PowerState::powerProfile() const
+{
+    return d->profile;
+}
+
+ThermalPressure PowerState::thermalPressure() const
+{
+    return d->thermalPressure;
+}
+
+PowerState PowerStatePrivate::snapshot()
+{
+    PowerStatePrivate *d = new PowerStatePrivate;
+    fillBackendState(d);
+    // only what is being tracked already, creating the trackers here could recurse
+    if (PowerProfilesPrivate::exists()) {
+        d->profile = PowerProfilesPrivate::instance()->profile;
+    }
+    if (ThermalMonitor::exists()) {
+        d->thermalPressure = ThermalMonitor::instance()->lastPressure();
+    }
+    return PowerState(d);
+}
+
+void PowerStatePrivate::notify(ChangedFlags changes)
+{
+    if (!changes) {
+        return;
+    }
+    SOLID_EMIT_SIGNAL("stateChanged", Solid::PowerManagement::notifier()->stateChanged(snapshot(), changes));
+}
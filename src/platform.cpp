@@ -21,13 +21,27 @@
 #include <QString>
 #include <QGlobalStatic>
 #include <QDebug>
-#include <QDBusReply>
 #include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
 
-#include <future>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
 
 #include "platform.h"
 #include "platform_p.h"
+#include "aggregator_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
 
 Q_LOGGING_CATEGORY(SOLID_PLATFORM, "solid.platform")
 
@@ -37,82 +51,615 @@ Q_LOGGING_CATEGORY(SOLID_PLATFORM, "solid.platform")
 
 #define DBUS_PROPS_IFACE QStringLiteral("org.freedesktop.DBus.Properties")
 
+#define PROP_CHASSIS QStringLiteral("Chassis")
+#define PROP_HOSTNAME QStringLiteral("Hostname")
+#define PROP_ICON_NAME QStringLiteral("IconName")
+#define PROP_OS_PRETTY_NAME QStringLiteral("OperatingSystemPrettyName")
+
+#define CACHE_FILE_NAME QStringLiteral("solid-platform.cache")
+#define CACHE_LOCK_FILE_NAME QStringLiteral("solid-platform.cache.lock")
+#define CACHE_MAGIC 0x31435053 // "SPC1"
+#define CACHE_VERSION 1
+
 Q_GLOBAL_STATIC(PlatformPrivate, globalPlatform)
+Q_GLOBAL_STATIC(PlatformIdentity, globalIdentity)
 
-QString getHostname1Property(const QString &name)
+/*
+ * Layout of the per-boot cache file in $XDG_RUNTIME_DIR, mapped as a whole
+ * when loading. The strings follow the header as raw UTF-16 data, the offsets
+ * are in bytes from the beginning of the file.
+ */
+struct PlatformCacheHeader
 {
-    QDBusMessage msg = QDBusMessage::createMethodCall(HOSTNAME1_SERVICE, HOSTNAME1_PATH, DBUS_PROPS_IFACE, QStringLiteral("Get"));
-    msg << HOSTNAME1_IFACE;
-    msg << name;
-    QDBusReply<QVariant> reply = QDBusConnection::systemBus().asyncCall(msg);
-    if (reply.isValid()) {
-        return reply.value().toString();
-    } else {
-        qCWarning(SOLID_PLATFORM) << name << reply.error().name() << reply.error().message();
+    quint32 magic;
+    quint32 version;
+    char bootId[40];
+    quint32 chassis;
+    quint32 hostnameOffset;
+    quint32 hostnameLength;
+    quint32 iconNameOffset;
+    quint32 iconNameLength;
+    quint32 prettyOSNameOffset;
+    quint32 prettyOSNameLength;
+};
+
+static QByteArray currentBootId()
+{
+    QFile file(QStringLiteral("/proc/sys/kernel/random/boot_id"));
+    if (file.open(QIODevice::ReadOnly)) {
+        return file.readAll().trimmed();
     }
-    return QString();
+    return QByteArray();
 }
 
-PlatformPrivate::PlatformPrivate()
+static QString currentHostname()
 {
-    QMetaObject::invokeMethod(this, "init");
+    char buf[256];
+    if (gethostname(buf, sizeof(buf) - 1) == 0) {
+        buf[sizeof(buf) - 1] = '\0';
+        return QString::fromLocal8Bit(buf);
+    }
+    return QString();
 }
 
-PlatformPrivate::~PlatformPrivate()
+namespace
 {
+// takes an exclusive flock without waiting, releasing it on every way out
+class CacheLock
+{
+public:
+    explicit CacheLock(const QString &path):
+        m_fd(::open(QFile::encodeName(path).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600))
+    {
+        if (m_fd != -1 && flock(m_fd, LOCK_EX | LOCK_NB) != 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    ~CacheLock()
+    {
+        if (m_fd != -1) {
+            close(m_fd); // releases the lock
+        }
+    }
+
+    bool isLocked() const
+    {
+        return m_fd != -1;
+    }
+
+private:
+    Q_DISABLE_COPY(CacheLock)
+
+    int m_fd;
+};
 }
 
-void PlatformPrivate::init()
+static QString cacheFilePath(const QString &fileName = CACHE_FILE_NAME)
 {
-    auto sfut = std::async(std::launch::async, getHostname1Property, QStringLiteral("Chassis"));
-    auto hfut = std::async(std::launch::async, getHostname1Property, QStringLiteral("Hostname"));
-    auto ifut = std::async(std::launch::async, getHostname1Property, QStringLiteral("IconName"));
-    auto ponfut = std::async(std::launch::async, getHostname1Property, QStringLiteral("OperatingSystemPrettyName"));
+    const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty()) {
+        return QString();
+    }
+    return runtimeDir + QLatin1Char('/') + fileName;
+}
 
-    const QString chs = sfut.get();
+static Solid::Platform::Chassis chassisFromString(const QString &chs)
+{
     if (chs == QStringLiteral("desktop") || chs.isEmpty()) {
-        chassis = Solid::Platform::Chassis::Desktop;
+        return Solid::Platform::Chassis::Desktop;
     } else if (chs == QStringLiteral("laptop")) {
-        chassis = Solid::Platform::Chassis::Laptop;
+        return Solid::Platform::Chassis::Laptop;
     } else if (chs == QStringLiteral("server")) {
-        chassis = Solid::Platform::Chassis::Server;
+        return Solid::Platform::Chassis::Server;
     } else if (chs == QStringLiteral("tablet")) {
-        chassis = Solid::Platform::Chassis::Tablet;
+        return Solid::Platform::Chassis::Tablet;
     } else if (chs == QStringLiteral("handset")) {
-        chassis = Solid::Platform::Chassis::Phone;
+        return Solid::Platform::Chassis::Phone;
     } else if (chs == QStringLiteral("vm")) {
-        chassis = Solid::Platform::Chassis::VM;
+        return Solid::Platform::Chassis::VM;
     } else if (chs == QStringLiteral("container")) {
-        chassis = Solid::Platform::Chassis::Container;
+        return Solid::Platform::Chassis::Container;
+    }
+    return Solid::Platform::Chassis::Unknown;
+}
+
+static QString readFirstLine(const QString &path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        return QString::fromUtf8(file.readLine().trimmed());
+    }
+    return QString();
+}
+
+static QString osReleasePrettyName()
+{
+    QFile file(QStringLiteral("/etc/os-release"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        file.setFileName(QStringLiteral("/usr/lib/os-release"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QString();
+        }
+    }
+
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        if (line.startsWith("PRETTY_NAME=")) {
+            QByteArray value = line.mid(qstrlen("PRETTY_NAME="));
+            if (value.size() >= 2 && (value.startsWith('"') || value.startsWith('\''))) {
+                value = value.mid(1, value.size() - 2);
+            }
+            return QString::fromUtf8(value);
+        }
+    }
+    return QString();
+}
+
+static QString detectVirtualization(const QString &vendor, const QString &model)
+{
+    // containers first, a container may well run inside a VM
+    const QString container = readFirstLine(QStringLiteral("/run/systemd/container"));
+    if (!container.isEmpty()) {
+        return container;
+    }
+    if (QFile::exists(QStringLiteral("/.dockerenv"))) {
+        return QStringLiteral("docker");
+    }
+    if (QFile::exists(QStringLiteral("/run/.containerenv"))) {
+        return QStringLiteral("podman");
+    }
+
+    const QString biosVendor = readFirstLine(QStringLiteral("/sys/class/dmi/id/bios_vendor"));
+    if (model.startsWith(QStringLiteral("KVM")) || vendor == QStringLiteral("KVM")) {
+        return QStringLiteral("kvm");
+    } else if (vendor.startsWith(QStringLiteral("QEMU")) || biosVendor.startsWith(QStringLiteral("SeaBIOS"))) {
+        return QStringLiteral("qemu");
+    } else if (vendor.startsWith(QStringLiteral("VMware"))) {
+        return QStringLiteral("vmware");
+    } else if (vendor == QStringLiteral("innotek GmbH") || model == QStringLiteral("VirtualBox")) {
+        return QStringLiteral("oracle");
+    } else if (vendor.startsWith(QStringLiteral("Xen"))) {
+        return QStringLiteral("xen");
+    } else if (vendor == QStringLiteral("Microsoft Corporation") && model == QStringLiteral("Virtual Machine")) {
+        return QStringLiteral("microsoft");
+    } else if (vendor.startsWith(QStringLiteral("Parallels"))) {
+        return QStringLiteral("parallels");
+    } else if (vendor.startsWith(QStringLiteral("Bochs"))) {
+        return QStringLiteral("bochs");
+    } else if (vendor == QStringLiteral("Amazon EC2")) {
+        return QStringLiteral("amazon");
+    }
+
+    if (readFirstLine(QStringLiteral("/sys/hypervisor/type")) == QStringLiteral("xen")) {
+        return QStringLiteral("xen");
+    }
+    return QString();
+}
+
+PlatformIdentity::PlatformIdentity()
+{
+    SOLID_TRACE_SCOPE("init", QStringLiteral("PlatformIdentity"));
+
+    hardwareVendor = readFirstLine(QStringLiteral("/sys/class/dmi/id/sys_vendor"));
+    hardwareModel = readFirstLine(QStringLiteral("/sys/class/dmi/id/product_name"));
+    firmwareDate = QDate::fromString(readFirstLine(QStringLiteral("/sys/class/dmi/id/bios_date")), QStringLiteral("MM/dd/yyyy"));
+    kernelVersion = readFirstLine(QStringLiteral("/proc/sys/kernel/osrelease"));
+    bootId = QString::fromLatin1(currentBootId());
+    machineId = readFirstLine(QStringLiteral("/etc/machine-id"));
+    if (machineId.isEmpty()) {
+        machineId = readFirstLine(QStringLiteral("/var/lib/dbus/machine-id"));
+    }
+    osPrettyName = osReleasePrettyName();
+
+    virtualization = detectVirtualization(hardwareVendor, hardwareModel);
+}
+
+void PlatformIdentity::setFallback(const QString &property, const QVariant &value)
+{
+    QMutexLocker locker(&mutex);
+    if (property == QStringLiteral("HardwareVendor") && hardwareVendor.isEmpty()) {
+        hardwareVendor = value.toString();
+    } else if (property == QStringLiteral("HardwareModel") && hardwareModel.isEmpty()) {
+        hardwareModel = value.toString();
+    } else if (property == QStringLiteral("FirmwareDate") && !firmwareDate.isValid()) {
+        const qulonglong usecs = value.toULongLong();
+        if (usecs > 0) {
+            firmwareDate = QDateTime::fromMSecsSinceEpoch(usecs / 1000, Qt::UTC).date();
+        }
+    } else if (property == QStringLiteral("KernelRelease") && kernelVersion.isEmpty()) {
+        kernelVersion = value.toString();
+    }
+}
+
+PlatformPrivate::PlatformPrivate():
+    m_data(new PlatformData)
+{
+    qRegisterMetaType<Solid::Platform::Chassis>();
+
+    SOLID_TRACE_SCOPE("init", QStringLiteral("PlatformPrivate::loadCache"));
+    PlatformData initialData;
+    cached = loadCache(initialData);
+    if (!cached) {
+        // what's known locally, until hostname1 answers
+        const QString hostname = currentHostname();
+        if (!hostname.isEmpty()) {
+            initialData.hostname = hostname;
+        }
+        initialData.prettyOSName = globalIdentity->osPrettyName;
+    }
+    delete m_data.exchange(new PlatformData(initialData)); // nobody could have read it yet
+
+    if (IoThread::isEnabled()) {
+        IoThread::adopt(this);
+    }
+    // nobody waits for hostname1: the getters return the current snapshot right away
+    QMetaObject::invokeMethod(this, "init", Qt::QueuedConnection);
+}
+
+PlatformPrivate::~PlatformPrivate()
+{
+}
+
+bool PlatformPrivate::loadCache(PlatformData &result)
+{
+    const QString path = cacheFilePath();
+    const QByteArray bootId = currentBootId();
+    if (path.isEmpty() || bootId.isEmpty()) {
+        return false;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < qint64(sizeof(PlatformCacheHeader))) {
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar *data = file.map(0, size);
+    if (!data) {
+        return false;
+    }
+
+    const PlatformCacheHeader *header = reinterpret_cast<const PlatformCacheHeader *>(data);
+    auto validString = [size](quint32 offset, quint32 length) {
+        return offset % 2 == 0 && qint64(offset) + qint64(length) * 2 <= size;
+    };
+    if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+            qstrncmp(header->bootId, bootId.constData(), sizeof(header->bootId)) != 0 ||
+            !validString(header->hostnameOffset, header->hostnameLength) ||
+            !validString(header->iconNameOffset, header->iconNameLength) ||
+            !validString(header->prettyOSNameOffset, header->prettyOSNameLength)) {
+        return false;
+    }
+
+    if (header->chassis > quint32(Solid::Platform::Chassis::Container)) {
+        return false;
+    }
+
+    const QString cachedHostname(reinterpret_cast<const QChar *>(data + header->hostnameOffset), header->hostnameLength);
+    if (cachedHostname != currentHostname()) {
+        // renamed while nobody was listening, refetch everything
+        return false;
+    }
+
+    result.chassis = static_cast<Solid::Platform::Chassis>(header->chassis);
+    result.hostname = cachedHostname;
+    result.iconName = QString(reinterpret_cast<const QChar *>(data + header->iconNameOffset), header->iconNameLength);
+    result.prettyOSName = QString(reinterpret_cast<const QChar *>(data + header->prettyOSNameOffset), header->prettyOSNameLength);
+    return true;
+}
+
+void PlatformPrivate::saveCache(const PlatformData &data)
+{
+    const QString path = cacheFilePath();
+    const QByteArray bootId = currentBootId();
+    if (path.isEmpty() || bootId.isEmpty()) {
+        return;
+    }
+
+    // every process using the library sees the same change; the first one to get here
+    // writes it, and the others find the cache current or being written
+    const CacheLock lock(cacheFilePath(CACHE_LOCK_FILE_NAME));
+    if (!lock.isLocked()) {
+        return;
+    }
+
+    PlatformData current;
+    if (loadCache(current) && current.chassis == data.chassis && current.hostname == data.hostname &&
+            current.iconName == data.iconName && current.prettyOSName == data.prettyOSName) {
+        return;
+    }
+
+    PlatformCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    qstrncpy(header.bootId, bootId.constData(), sizeof(header.bootId));
+    header.chassis = static_cast<quint32>(data.chassis);
+
+    quint32 offset = sizeof(PlatformCacheHeader);
+    header.hostnameOffset = offset;
+    header.hostnameLength = data.hostname.size();
+    offset += data.hostname.size() * 2;
+    header.iconNameOffset = offset;
+    header.iconNameLength = data.iconName.size();
+    offset += data.iconName.size() * 2;
+    header.prettyOSNameOffset = offset;
+    header.prettyOSNameLength = data.prettyOSName.size();
+
+    // written to a temporary file and renamed, so concurrent readers never see a partial cache
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(SOLID_PLATFORM) << "Cannot write platform cache" << path << file.errorString();
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(data.hostname.constData()), data.hostname.size() * 2);
+    file.write(reinterpret_cast<const char *>(data.iconName.constData()), data.iconName.size() * 2);
+    file.write(reinterpret_cast<const char *>(data.prettyOSName.constData()), data.prettyOSName.size() * 2);
+    if (!file.commit()) {
+        qCWarning(SOLID_PLATFORM) << "Cannot write platform cache" << path << file.errorString();
+    }
+}
+
+void PlatformPrivate::init()
+{
+    SOLID_TRACE_SCOPE("init", cached ? QStringLiteral("PlatformPrivate::init (cached)") : QStringLiteral("PlatformPrivate::init"));
+
+    // stay current with hostname1, also when the values came from the cache
+    QDBusConnection::systemBus().connect(HOSTNAME1_SERVICE, HOSTNAME1_PATH, DBUS_PROPS_IFACE,
+                                         QStringLiteral("PropertiesChanged"),
+                                         this, SLOT(hostname1PropertiesChanged(QString, QVariantMap, QStringList)));
+    fetchIdentityFallbacks();
+    if (!cached) {
+        fetch();
+    }
+}
+
+void PlatformPrivate::fetch()
+{
+    ServiceHealth *health = ServiceHealth::forService(HOSTNAME1_SERVICE);
+    if (!health->allowCall()) {
+        return;
     }
 
-    hostname = hfut.get();
-    if (hostname.isEmpty()) {
-        hostname = QStringLiteral("localhost");
+    QDBusMessage msg = QDBusMessage::createMethodCall(HOSTNAME1_SERVICE, HOSTNAME1_PATH, DBUS_PROPS_IFACE, QStringLiteral("GetAll"));
+    msg << HOSTNAME1_IFACE;
+    const QDBusPendingCall call = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+    DiagnosticsPrivate::trackPendingCall(HOSTNAME1_SERVICE, QStringLiteral("GetAll"), call);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, health](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusPendingReply<QVariantMap> reply = *watcher;
+        if (!reply.isValid()) {
+            // the local values stay, uncached
+            qCWarning(SOLID_PLATFORM) << "GetAll" << reply.error().name() << reply.error().message();
+            health->recordFailure(reply.error());
+            return;
+        }
+        health->recordSuccess();
+
+        // newer than any PropertiesChanged received before it
+        const QVariantMap properties = reply.value();
+        PlatformData fetched = *data();
+        const QString chassis = properties.value(PROP_CHASSIS).toString();
+        fetched.chassis = chassisFromString(chassis);
+        // hostname1 always has a chassis, hostname and icon name: empty ones mean it failed
+        bool complete = !chassis.isEmpty();
+
+        fetched.hostname = properties.value(PROP_HOSTNAME).toString();
+        if (fetched.hostname.isEmpty()) {
+            fetched.hostname = QStringLiteral("localhost");
+            complete = false;
+        }
+        fetched.iconName = properties.value(PROP_ICON_NAME).toString();
+        if (fetched.iconName.isEmpty()) {
+            fetched.iconName = QStringLiteral("computer");
+            complete = false;
+        }
+        fetched.prettyOSName = properties.value(PROP_OS_PRETTY_NAME).toString();
+        if (fetched.prettyOSName.isEmpty()) {
+            fetched.prettyOSName = globalIdentity->osPrettyName;
+        }
+        publish(fetched, complete);
+    });
+}
+
+void PlatformPrivate::fetchIdentityFallbacks()
+{
+    // systems without DMI or procfs; not waited for, the getters return what's there
+    QStringList missing;
+    {
+        QMutexLocker locker(&globalIdentity->mutex);
+        if (globalIdentity->hardwareVendor.isEmpty()) {
+            missing << QStringLiteral("HardwareVendor");
+        }
+        if (globalIdentity->hardwareModel.isEmpty()) {
+            missing << QStringLiteral("HardwareModel");
+        }
+        if (!globalIdentity->firmwareDate.isValid()) {
+            missing << QStringLiteral("FirmwareDate");
+        }
+        if (globalIdentity->kernelVersion.isEmpty()) {
+            missing << QStringLiteral("KernelRelease");
+        }
+    }
+
+    ServiceHealth *health = ServiceHealth::forService(HOSTNAME1_SERVICE);
+    for (const QString &name : missing) {
+        if (!health->allowCall()) {
+            return;
+        }
+        QDBusMessage msg = QDBusMessage::createMethodCall(HOSTNAME1_SERVICE, HOSTNAME1_PATH, DBUS_PROPS_IFACE, QStringLiteral("Get"));
+        msg << HOSTNAME1_IFACE;
+        msg << name;
+        const QDBusPendingCall call = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+        DiagnosticsPrivate::trackPendingCall(HOSTNAME1_SERVICE, QStringLiteral("Get ") + name, call);
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [name, health](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+            QDBusPendingReply<QVariant> reply = *watcher;
+            if (reply.isValid()) {
+                health->recordSuccess();
+                globalIdentity->setFallback(name, reply.value());
+            } else {
+                qCWarning(SOLID_PLATFORM) << name << reply.error().name() << reply.error().message();
+                health->recordFailure(reply.error());
+            }
+        });
+    }
+}
+
+const PlatformData *PlatformPrivate::data() const
+{
+    return m_data.load(std::memory_order_acquire);
+}
+
+void PlatformPrivate::publish(const PlatformData &newData, bool complete, bool notify)
+{
+    // the old snapshot is leaked on purpose, see PlatformData
+    const PlatformData *oldData = m_data.exchange(new PlatformData(newData), std::memory_order_acq_rel);
+    // the fallbacks of a failing hostname1 must not outlive it
+    m_complete = complete;
+    if (complete) {
+        saveCache(newData);
+    }
+    if (!notify) {
+        return;
+    }
+
+    if (oldData->chassis != newData.chassis) {
+        SOLID_EMIT_SIGNAL("chassisChanged", chassisChanged(newData.chassis));
+    }
+    if (oldData->hostname != newData.hostname) {
+        SOLID_EMIT_SIGNAL("hostnameChanged", hostnameChanged(newData.hostname));
+    }
+    if (oldData->iconName != newData.iconName) {
+        SOLID_EMIT_SIGNAL("iconNameChanged", iconNameChanged(newData.iconName));
     }
-    iconName = ifut.get();
-    if (iconName.isEmpty()) {
-        iconName = QStringLiteral("computer");
+    if (oldData->prettyOSName != newData.prettyOSName) {
+        SOLID_EMIT_SIGNAL("prettyOSNameChanged", prettyOSNameChanged(newData.prettyOSName));
     }
-    prettyOSName = ponfut.get();
+}
+
+void PlatformPrivate::hostname1PropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated)
+{
+    Q_UNUSED(invalidated)
+    DiagnosticsPrivate::signalReceived();
+    if (interface != HOSTNAME1_IFACE) {
+        return;
+    }
+
+    PlatformData updated = *data();
+    bool changed = false;
+    bool complete = m_complete;
+    if (changedProperties.contains(PROP_CHASSIS)) {
+        updated.chassis = chassisFromString(changedProperties.value(PROP_CHASSIS).toString());
+        changed = true;
+    }
+    if (changedProperties.contains(PROP_HOSTNAME)) {
+        updated.hostname = changedProperties.value(PROP_HOSTNAME).toString();
+        if (updated.hostname.isEmpty()) {
+            updated.hostname = QStringLiteral("localhost");
+            complete = false;
+        }
+        changed = true;
+    }
+    if (changedProperties.contains(PROP_ICON_NAME)) {
+        updated.iconName = changedProperties.value(PROP_ICON_NAME).toString();
+        if (updated.iconName.isEmpty()) {
+            updated.iconName = QStringLiteral("computer");
+            complete = false;
+        }
+        changed = true;
+    }
+
+    if (changed) {
+        publish(updated, complete);
+    }
+}
+
+Solid::Platform::Notifier::Notifier()
+{
+}
+
+Solid::Platform::Notifier *Solid::Platform::notifier()
+{
+    return globalPlatform;
 }
 
 Solid::Platform::Chassis Solid::Platform::chassis()
 {
-    return globalPlatform->chassis;
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return static_cast<Solid::Platform::Chassis>(shared.chassis);
+    }
+    return globalPlatform->data()->chassis;
 }
 
 QString Solid::Platform::hostname()
 {
-    return globalPlatform->hostname;
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return Aggregator::SharedState::text(shared.hostname, sizeof(shared.hostname));
+    }
+    return globalPlatform->data()->hostname;
 }
 
 QString Solid::Platform::iconName()
 {
-    return globalPlatform->iconName;
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return Aggregator::SharedState::text(shared.iconName, sizeof(shared.iconName));
+    }
+    return globalPlatform->data()->iconName;
 }
 
 QString Solid::Platform::prettyOSName()
 {
-    return globalPlatform->prettyOSName;
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return Aggregator::SharedState::text(shared.prettyOSName, sizeof(shared.prettyOSName));
+    }
+    return globalPlatform->data()->prettyOSName;
+}
+
+QString Solid::Platform::hardwareVendor()
+{
+    QMutexLocker locker(&globalIdentity->mutex);
+    return globalIdentity->hardwareVendor;
+}
+
+QString Solid::Platform::hardwareModel()
+{
+    QMutexLocker locker(&globalIdentity->mutex);
+    return globalIdentity->hardwareModel;
+}
+
+QDate Solid::Platform::firmwareDate()
+{
+    QMutexLocker locker(&globalIdentity->mutex);
+    return globalIdentity->firmwareDate;
+}
+
+QString Solid::Platform::kernelVersion()
+{
+    QMutexLocker locker(&globalIdentity->mutex);
+    return globalIdentity->kernelVersion;
+}
+
+QString Solid::Platform::bootId()
+{
+    return globalIdentity->bootId;
+}
+
+QString Solid::Platform::machineId()
+{
+    return globalIdentity->machineId;
+}
+
+QString Solid::Platform::virtualization()
+{
+    return globalIdentity->virtualization;
 }
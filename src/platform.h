@@ -23,6 +23,8 @@
 #ifndef SOLID_PLATFORM_H
 #define SOLID_PLATFORM_H
 
+#include <QDate>
+#include <QObject>
 #include <QString>
 
 namespace Solid {
@@ -79,8 +81,114 @@ SOLIDPOWER_EXPORT QString iconName();
   */
 SOLIDPOWER_EXPORT QString prettyOSName();
 
+/**
+  * @return the hardware vendor (manufacturer) of the system, or an empty string if unknown
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString hardwareVendor();
+
+/**
+  * @return the hardware model (product name) of the system, or an empty string if unknown
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString hardwareModel();
+
+/**
+  * @return the release date of the system firmware (BIOS/UEFI), or an invalid date if unknown
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QDate firmwareDate();
+
+/**
+  * @return the release of the running kernel (e.g. "4.1.6-200.fc22.x86_64")
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString kernelVersion();
+
+/**
+  * @return the ID of the current boot, changes with every reboot
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString bootId();
+
+/**
+  * @return the unique machine ID of the local system (see machine-id(5))
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString machineId();
+
+/**
+  * @return the virtualization technology the system runs in, using the identifiers of
+  * systemd-detect-virt (e.g. "kvm", "vmware", "oracle", "docker"), or an empty string
+  * when running on bare metal
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QString virtualization();
+
+/**
+ * @brief The Notifier class
+ *
+ * Emits change signals when the platform data is updated at runtime, e.g.
+ * when the machine gets renamed. The getters above always return the latest
+ * values, without any bus traffic.
+ *
+ * Example:
+ * @code
+ *   QObject::connect(Solid::Platform::notifier(), &Solid::Platform::Notifier::hostnameChanged,
+ *                    [](const QString &hostname) {
+ *       qDebug() << "The hostname is now:" << hostname;
+ *   });
+ * @endcode
+ *
+ * @since 5.x
+ */
+class SOLIDPOWER_EXPORT Notifier : public QObject
+{
+    Q_OBJECT
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the chassis type changes
+     * @param chassis the new chassis type
+     * @see chassis()
+     */
+    void chassisChanged(Solid::Platform::Chassis chassis);
+
+    /**
+     * This signal is emitted when the system's hostname changes
+     * @param hostname the new hostname
+     * @see hostname()
+     */
+    void hostnameChanged(const QString &hostname);
+
+    /**
+     * This signal is emitted when the icon representing the system changes
+     * @param iconName the new icon name
+     * @see iconName()
+     */
+    void iconNameChanged(const QString &iconName);
+
+    /**
+     * This signal is emitted when the name of the operating system changes
+     * @param prettyOSName the new user-friendly operating system name
+     * @see prettyOSName()
+     */
+    void prettyOSNameChanged(const QString &prettyOSName);
+
+protected:
+    Notifier();
+};
+
+/**
+  * Provides access to the Notifier class
+  *
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT Notifier *notifier();
+
 } // namespace Platform
 
 } // namespace Solid
 
+Q_DECLARE_METATYPE(Solid::Platform::Chassis)
+
 #endif
@@ -21,27 +21,87 @@
 #ifndef SOLID_PLATFORM_P_H
 #define SOLID_PLATFORM_P_H
 
+#include <QDate>
+#include <QMutex>
 #include <QObject>
 #include <QLoggingCategory>
+#include <QVariant>
+
+#include <atomic>
 
 #include "platform.h"
 
 Q_DECLARE_LOGGING_CATEGORY(SOLID_PLATFORM)
 
-class PlatformPrivate: public QObject {
+/*
+ * Immutable snapshot of the platform data, replaced as a whole on every
+ * change. Readers load the current one with a single acquire load, no lock
+ * and no reference counting; the replaced ones are never freed, since a
+ * reader may still be copying from them. They only change along with the
+ * hostname or the chassis, so the few bytes leaked don't add up.
+ */
+struct PlatformData
+{
+    Solid::Platform::Chassis chassis = Solid::Platform::Chassis::Unknown;
+    QString hostname = QStringLiteral("localhost");
+    QString iconName = QStringLiteral("computer");
+    QString prettyOSName;
+};
+
+/*
+ * Identity data read once from local files (DMI, procfs, /etc). What's
+ * missing there gets asked from hostname1 later on, asynchronously, see
+ * PlatformPrivate::fetchIdentityFallbacks().
+ */
+struct PlatformIdentity
+{
+    PlatformIdentity();
+
+    // for a reply from hostname1, only fills in what's still empty
+    void setFallback(const QString &property, const QVariant &value);
+
+    // guards the fields hostname1 can fill in
+    mutable QMutex mutex;
+    QString hardwareVendor;
+    QString hardwareModel;
+    QDate firmwareDate;
+    QString kernelVersion;
+
+    QString bootId;
+    QString machineId;
+    QString virtualization;
+    QString osPrettyName;
+};
+
+class PlatformPrivate: public Solid::Platform::Notifier {
     Q_OBJECT
 public:
     PlatformPrivate();
     ~PlatformPrivate();
 
+    const PlatformData *data() const;
+    // @p complete: no fallback value in there, i.e. worth caching
+    void publish(const PlatformData &newData, bool complete, bool notify = true);
+
+    bool loadCache(PlatformData &result);
+    void saveCache(const PlatformData &data);
+
+    // asks hostname1 for what the local files lacked, see PlatformIdentity
+    void fetchIdentityFallbacks();
+
 public Q_SLOTS:
     void init();
+    void hostname1PropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated);
 
 public:
-    Solid::Platform::Chassis chassis = Solid::Platform::Chassis::Unknown;
-    QString hostname = QStringLiteral("localhost");
-    QString iconName = QStringLiteral("computer");
-    QString prettyOSName;
+    bool cached = false;
+
+private:
+    // asks hostname1 for all of it, and publishes the reply
+    void fetch();
+
+    std::atomic<const PlatformData *> m_data;
+    std::atomic<bool> m_complete {false};
 };
 
 #endif
@@ -22,11 +22,22 @@
 #include <QString>
 #include <QGlobalStatic>
 #include <QDebug>
-#include <QDBusReply>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QThread>
+#include <QDBusPendingReply>
 #include <QDBusMetaType>
 
+#include <climits>
+
 #include "powermanagement.h"
 #include "power_hal_p.h"
+#include "powerstate_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "powertrace_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
 
 Q_LOGGING_CATEGORY(SOLID_POWER, "solid.power.hal")
 
@@ -38,6 +49,13 @@ Q_LOGGING_CATEGORY(SOLID_POWER, "solid.power.hal")
 #define HAL_IFACE_POWER QStringLiteral("org.freedesktop.Hal.Device.SystemPowerManagement")
 #define HAL_IFACE_MANAGER QStringLiteral("org.freedesktop.Hal.Manager")
 
+#define HAL_PROP_POWERSAVE QStringLiteral("power_management.is_powersave_set")
+#define HAL_PROP_CAN_SUSPEND QStringLiteral("power_management.can_suspend")
+#define HAL_PROP_CAN_HIBERNATE QStringLiteral("power_management.can_hibernate")
+#define HAL_PROP_CAN_HYBRID QStringLiteral("power_management.can_suspend_hybrid")
+#define HAL_PROP_POWER_METHODS QStringLiteral("org.freedesktop.Hal.Device.SystemPowerManagement.method_names")
+#define HAL_PROP_LID_STATE QStringLiteral("button.state.value")
+
 Q_GLOBAL_STATIC(Solid::PowerManagementPrivate, globalPowerManager)
 
 Q_DECLARE_METATYPE(ChangeDescription)
@@ -59,117 +77,259 @@ const QDBusArgument &operator>>(const QDBusArgument &arg, ChangeDescription &cha
     return arg;
 }
 
+/*
+ * Plain, pre-typed method calls: unlike QDBusInterface, they don't introspect
+ * the remote object, which would cost a blocking round trip and keep the
+ * parsed XML around.
+ */
+static QDBusPendingCall halAsyncCall(const QString &path, const QString &interface, const QString &method,
+                                     const QVariantList &args, int timeout = -1)
+{
+    QDBusMessage msg = QDBusMessage::createMethodCall(HAL_SERVICE, path, interface, method);
+    msg.setArguments(args);
+    return QDBusConnection::systemBus().asyncCall(msg, timeout);
+}
+
 // private
-Solid::PowerManagementPrivate::PowerManagementPrivate():
-    halComputer(HAL_SERVICE, HAL_PATH, HAL_IFACE_DEVICE,
-                QDBusConnection::systemBus()),
-    halPowerManagement(HAL_SERVICE, HAL_PATH, HAL_IFACE_POWER,
-                       QDBusConnection::systemBus()),
-    halManager(HAL_SERVICE, HAL_PATH_MANAGER, HAL_IFACE_MANAGER,
-               QDBusConnection::systemBus())
+Solid::PowerManagementPrivate::PowerManagementPrivate()
 {
+    if (PowerTrace::isRecording() || PowerTrace::isReplaying()) {
+        qCWarning(SOLID_POWER) << "Recording and replaying are only supported by the login1 backend, ignoring SOLID_POWER_RECORD and SOLID_POWER_REPLAY";
+    }
     qDBusRegisterMetaType<ChangeDescription>();
     qDBusRegisterMetaType<QList<ChangeDescription> >();
-    QMetaObject::invokeMethod(this, "init");
+
+    if (IoThread::isEnabled()) {
+        // init() creates children, it has to run in our new thread
+        IoThread::adopt(this);
+        QMetaObject::invokeMethod(this, "init", thread() == QThread::currentThread() ? Qt::DirectConnection : Qt::QueuedConnection);
+    } else {
+        QMetaObject::invokeMethod(this, "init");
+    }
 }
 
 Solid::PowerManagementPrivate::~PowerManagementPrivate()
 {
+    IoThread::shutdown();
 }
 
-bool Solid::PowerManagementPrivate::checkHalProperty(const QString &prop)
+void Solid::PowerManagementPrivate::checkHalProperty(const QString &prop)
 {
-    QDBusReply<bool> reply = halComputer.asyncCall(QStringLiteral("GetPropertyBoolean"), prop);
-    if (reply.isValid()) {
-        //qCDebug(SOLID_POWER) << prop << reply.value();
-        return reply;
-    } else {
-        qCWarning(SOLID_POWER) << prop << reply.error().name() << reply.error().message();
+    requestHalProperty(HAL_PATH, prop);
+}
+
+void Solid::PowerManagementPrivate::requestHalProperty(const QString &path, const QString &prop)
+{
+    const QString key = path + QLatin1Char('|') + prop;
+    auto it = pendingReads.find(key);
+    if (it != pendingReads.end()) {
+        // coalesce: re-read once more when the current reply arrives
+        it->stale = true;
+        return;
     }
-    return false;
+
+    ServiceHealth *health = ServiceHealth::forService(HAL_SERVICE);
+    if (!health->allowCall()) {
+        // HAL is hung, keep the values we already have
+        return;
+    }
+
+    const QDBusPendingCall call = halAsyncCall(path, HAL_IFACE_DEVICE, QStringLiteral("GetPropertyBoolean"),
+                                               QVariantList() << prop, health->timeout());
+    DiagnosticsPrivate::trackPendingCall(HAL_SERVICE, QStringLiteral("GetPropertyBoolean ") + prop, call);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    watcher->setProperty("halPath", path);
+    watcher->setProperty("halProperty", prop);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &PowerManagementPrivate::slotHalPropertyReply);
+    pendingReads.insert(key, PendingRead{watcher, false});
 }
 
 void Solid::PowerManagementPrivate::makeHalCall(const QString &method, int param)
 {
     qCDebug(SOLID_POWER) << "Making HAL call:" << method;
-    halPowerManagement.asyncCall(method, param);
+    // INT_MAX is no timeout, -1 the 25s default: Suspend and friends only return on resume
+    DiagnosticsPrivate::trackPendingCall(HAL_SERVICE, method, halAsyncCall(HAL_PATH, HAL_IFACE_POWER, method, QVariantList() << param, INT_MAX));
 }
 
-void Solid::PowerManagementPrivate::init()
+void Solid::PowerManagementPrivate::applyHalProperty(const QString &path, const QString &prop, bool value)
 {
-    // init the power save mode
-    powerSaveMode = checkHalProperty(QStringLiteral("power_management.is_powersave_set"));
+    if (path == lidPath && prop == HAL_PROP_LID_STATE) {
+        if (value != isLidClosed) {
+            isLidClosed = value;
+            SOLID_EMIT_SIGNAL("isLidClosedChanged", isLidClosedChanged(isLidClosed));
+            Solid::PowerManagement::PowerStatePrivate::notify(Solid::PowerManagement::LidClosedChanged);
+        }
+        return;
+    }
 
-    // get the supported sleep methods
-    if (checkHalProperty(QStringLiteral("power_management.can_suspend"))) {
-        supportedSleepStates += Solid::PowerManagement::SuspendState;
+    if (path != HAL_PATH) {
+        return;
+    }
+
+    if (prop == HAL_PROP_POWERSAVE) {
+        if (value != powerSaveMode) {
+            powerSaveMode = value;
+            SOLID_EMIT_SIGNAL("appShouldConserveResourcesChanged", appShouldConserveResourcesChanged(powerSaveMode));
+            Solid::PowerManagement::PowerStatePrivate::notify(Solid::PowerManagement::ConserveResourcesChanged);
+        }
+        return;
     }
-    if (checkHalProperty(QStringLiteral("power_management.can_hibernate"))) {
-        supportedSleepStates += Solid::PowerManagement::HibernateState;
+
+    Solid::PowerManagement::SleepState state;
+    if (prop == HAL_PROP_CAN_SUSPEND) {
+        state = Solid::PowerManagement::SuspendState;
+    } else if (prop == HAL_PROP_CAN_HIBERNATE) {
+        state = Solid::PowerManagement::HibernateState;
+    } else if (prop == HAL_PROP_CAN_HYBRID) {
+        state = Solid::PowerManagement::HybridSuspendState;
+    } else {
+        return;
     }
-    if (checkHalProperty(QStringLiteral("power_management.can_suspend_hybrid"))) {
-        supportedSleepStates += Solid::PowerManagement::HybridSuspendState;
+
+    if (value) {
+        supportedSleepStates |= state;
+    } else {
+        supportedSleepStates &= ~state;
     }
+}
 
-    // subscribe to the power save mode property updates
+void Solid::PowerManagementPrivate::init()
+{
+    SOLID_TRACE_SCOPE("init", QStringLiteral("PowerManagementPrivate::init"));
+
+    // fire all the property probes at once, the replies get applied as they arrive
+    checkHalProperty(HAL_PROP_POWERSAVE);
+    checkHalProperty(HAL_PROP_CAN_SUSPEND);
+    checkHalProperty(HAL_PROP_CAN_HIBERNATE);
+    checkHalProperty(HAL_PROP_CAN_HYBRID);
+
+    const int timeout = ServiceHealth::forService(HAL_SERVICE)->timeout();
+
+    // reboot/shutdown availability, as advertised by the SystemPowerManagement interface
+    const QDBusPendingCall methodsCall = halAsyncCall(HAL_PATH, HAL_IFACE_DEVICE, QStringLiteral("GetPropertyStringList"),
+                                                      QVariantList() << HAL_PROP_POWER_METHODS, timeout);
+    DiagnosticsPrivate::trackPendingCall(HAL_SERVICE, QStringLiteral("GetPropertyStringList ") + HAL_PROP_POWER_METHODS, methodsCall);
+    QDBusPendingCallWatcher *methodsWatcher = new QDBusPendingCallWatcher(methodsCall, this);
+    connect(methodsWatcher, &QDBusPendingCallWatcher::finished, this, &PowerManagementPrivate::slotMethodNamesReply);
+
+    // find the lid, if any
+    const QDBusPendingCall lidCall = halAsyncCall(HAL_PATH_MANAGER, HAL_IFACE_MANAGER, QStringLiteral("FindDeviceStringMatch"),
+                                                  QVariantList() << QStringLiteral("button.type") << QStringLiteral("lid"), timeout);
+    DiagnosticsPrivate::trackPendingCall(HAL_SERVICE, QStringLiteral("FindDeviceStringMatch"), lidCall);
+    QDBusPendingCallWatcher *lidWatcher = new QDBusPendingCallWatcher(lidCall, this);
+    connect(lidWatcher, &QDBusPendingCallWatcher::finished, this, &PowerManagementPrivate::slotLidFound);
+
+    // subscribe to the power save mode and capability property updates
     QDBusConnection::systemBus().connect(HAL_SERVICE, HAL_PATH, HAL_IFACE_DEVICE,
                                          QStringLiteral("PropertyModified"), this,
                                          SLOT(slotPropertyModified(int,QList<ChangeDescription>)));
+}
 
-    // find the lid, if any
-    QDBusReply<QStringList> lidCall = halManager.asyncCall(QStringLiteral("FindDeviceStringMatch"), QStringLiteral("button.type"), QStringLiteral("lid"));
-    if (lidCall.isValid() && !lidCall.value().isEmpty()) {
-        const QString path = lidCall.value().first();
-        if (!path.isEmpty() && path != QStringLiteral("/")) {
-            lidIface = new QDBusInterface(HAL_SERVICE, path, HAL_IFACE_DEVICE, QDBusConnection::systemBus(), this);
-            if (lidIface->isValid()) {
-                hasLid = true;
-                slotLidButtonPressed();
-                // setup notifier signals
-                QDBusConnection::systemBus().connect(HAL_SERVICE, path, HAL_IFACE_DEVICE,
-                                                     QStringLiteral("Condition"), this,
-                                                     SLOT(slotLidButtonPressed(QString, QString)));
-            }
-        }
+void Solid::PowerManagementPrivate::slotHalPropertyReply(QDBusPendingCallWatcher *watcher)
+{
+    const QString path = watcher->property("halPath").toString();
+    const QString prop = watcher->property("halProperty").toString();
+    watcher->deleteLater();
+
+    // the outcome counts even for an outdated reply, it may be the breaker's probe
+    QDBusPendingReply<bool> reply = *watcher;
+    ServiceHealth *health = ServiceHealth::forService(HAL_SERVICE);
+    if (reply.isValid()) {
+        health->recordSuccess();
+    } else {
+        qCWarning(SOLID_POWER) << path << prop << reply.error().name() << reply.error().message();
+        health->recordFailure(reply.error());
+    }
+
+    const PendingRead pending = pendingReads.take(path + QLatin1Char('|') + prop);
+    if (pending.stale) {
+        // the value changed again meanwhile, this reply is already outdated
+        requestHalProperty(path, prop);
+        return;
+    }
+
+    if (reply.isValid()) {
+        //qCDebug(SOLID_POWER) << path << prop << reply.value();
+        applyHalProperty(path, prop, reply.value());
+    }
+}
+
+void Solid::PowerManagementPrivate::slotMethodNamesReply(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<QStringList> reply = *watcher;
+    if (reply.isValid()) {
+        const QStringList methods = reply.value();
+        canReboot = methods.contains(QStringLiteral("Reboot"));
+        canShutdown = methods.contains(QStringLiteral("Shutdown"));
     } else {
-        qCWarning(SOLID_POWER) << lidCall.error().name() << lidCall.error().message();
+        qCWarning(SOLID_POWER) << HAL_PROP_POWER_METHODS << reply.error().name() << reply.error().message();
+    }
+    watcher->deleteLater();
+}
+
+void Solid::PowerManagementPrivate::slotLidFound(QDBusPendingCallWatcher *watcher)
+{
+    SOLID_TRACE_SCOPE("init", QStringLiteral("PowerManagementPrivate::slotLidFound"));
+    QDBusPendingReply<QStringList> reply = *watcher;
+    watcher->deleteLater();
+    if (!reply.isValid()) {
+        qCWarning(SOLID_POWER) << reply.error().name() << reply.error().message();
+        return;
+    }
+
+    const QStringList lids = reply.value();
+    if (lids.isEmpty()) {
+        return;
+    }
+
+    // HAL only returns existing devices, no need to introspect it to make sure
+    const QString path = lids.first();
+    if (!path.isEmpty() && path != QStringLiteral("/")) {
+        lidPath = path;
+        hasLid = true;
+        slotLidButtonPressed();
+        // setup notifier signals
+        QDBusConnection::systemBus().connect(HAL_SERVICE, path, HAL_IFACE_DEVICE,
+                                             QStringLiteral("Condition"), this,
+                                             SLOT(slotLidButtonPressed(QString, QString)));
     }
 }
 
 void Solid::PowerManagementPrivate::slotLidButtonPressed(const QString &type, const QString &reason)
 {
     Q_UNUSED(reason)
-    const bool wasClosed = isLidClosed;
-    if (type == QStringLiteral("ButtonPressed")) {
-        QDBusReply<bool> lidReply = lidIface->asyncCall(QStringLiteral("GetPropertyBoolean"), QStringLiteral("button.state.value"));
-        if (lidReply.isValid()) {
-            if (lidReply != wasClosed) {
-                isLidClosed = lidReply;
-                Q_EMIT isLidClosedChanged(isLidClosed);
-            }
-        }
+    DiagnosticsPrivate::signalReceived();
+    if (type == QStringLiteral("ButtonPressed") && hasLid) {
+        requestHalProperty(lidPath, HAL_PROP_LID_STATE);
     }
 }
 
 void Solid::PowerManagementPrivate::slotPropertyModified(int count, const QList<ChangeDescription> &changes)
 {
     Q_UNUSED(count)
+    DiagnosticsPrivate::signalReceived();
     // Int num_changes, Array of struct {String property_name, Bool added, Bool removed}
     Q_FOREACH(const ChangeDescription &change, changes) {
-        if (change.key == QStringLiteral("power_management.is_powersave_set") && !change.added && !change.removed) {
-            powerSaveMode = checkHalProperty(QStringLiteral("power_management.is_powersave_set"));
-            Q_EMIT appShouldConserveResourcesChanged(powerSaveMode);
+        if (change.added || change.removed) {
+            continue;
+        }
+        if (change.key == HAL_PROP_POWERSAVE || change.key == HAL_PROP_CAN_SUSPEND ||
+                change.key == HAL_PROP_CAN_HIBERNATE || change.key == HAL_PROP_CAN_HYBRID) {
+            checkHalProperty(change.key);
         }
     }
 }
 
-Solid::PowerManagement::Notifier::Notifier()
+Solid::PowerManagement::Notifier *Solid::PowerManagement::notifier()
 {
+    return globalPowerManager;
 }
 
-Solid::PowerManagement::Notifier *Solid::PowerManagement::notifier()
+void Solid::PowerManagement::PowerStatePrivate::fillBackendState(PowerStatePrivate *d)
 {
-    return globalPowerManager;
+    d->conserveResources = globalPowerManager->powerSaveMode;
+    d->hasLid = globalPowerManager->hasLid;
+    d->lidClosed = globalPowerManager->isLidClosed;
 }
 
 // public
@@ -180,61 +340,79 @@ bool Solid::PowerManagement::appShouldConserveResources()
 
 bool Solid::PowerManagement::canSuspend()
 {
-    return globalPowerManager->supportedSleepStates.contains(SuspendState);
+    return globalPowerManager->supportedSleepStates & SuspendState;
 }
 
 bool Solid::PowerManagement::canHibernate()
 {
-    return globalPowerManager->supportedSleepStates.contains(HibernateState);
+    return globalPowerManager->supportedSleepStates & HibernateState;
 }
 
 bool Solid::PowerManagement::canHybridSleep()
 {
-    return globalPowerManager->supportedSleepStates.contains(HybridSuspendState);
+    return globalPowerManager->supportedSleepStates & HybridSuspendState;
+}
+
+bool Solid::PowerManagement::canSuspendThenHibernate()
+{
+    // not offered by HAL
+    return false;
 }
 
 bool Solid::PowerManagement::canReboot()
 {
-    return true; // TODO check
+    return globalPowerManager->canReboot;
 }
 
 bool Solid::PowerManagement::canShutdown()
 {
-    return true; // TODO check
+    return globalPowerManager->canShutdown;
 }
 
 QSet<Solid::PowerManagement::SleepState> Solid::PowerManagement::supportedSleepStates()
 {
-    return globalPowerManager->supportedSleepStates;
+    QSet<Solid::PowerManagement::SleepState> result;
+    const int states = globalPowerManager->supportedSleepStates;
+    for (SleepState state : {SuspendState, HibernateState, HybridSuspendState}) {
+        if (states & state) {
+            result += state;
+        }
+    }
+    return result;
 }
 
 void Solid::PowerManagement::suspend()
 {
-    Q_EMIT globalPowerManager->aboutToSuspend(); // yea :)
+    SOLID_EMIT_SIGNAL("aboutToSuspend", globalPowerManager->aboutToSuspend()); // yea :)
     globalPowerManager->makeHalCall(QStringLiteral("Suspend"));
 }
 
 void Solid::PowerManagement::hibernate()
 {
-    Q_EMIT globalPowerManager->aboutToSuspend(); // yea :)
+    SOLID_EMIT_SIGNAL("aboutToSuspend", globalPowerManager->aboutToSuspend()); // yea :)
     globalPowerManager->makeHalCall(QStringLiteral("Hibernate"), -1);
 }
 
 void Solid::PowerManagement::hybridSleep()
 {
-    Q_EMIT globalPowerManager->aboutToSuspend(); // yea :)
+    SOLID_EMIT_SIGNAL("aboutToSuspend", globalPowerManager->aboutToSuspend()); // yea :)
     globalPowerManager->makeHalCall(QStringLiteral("SuspendHybrid"));
 }
 
+void Solid::PowerManagement::suspendThenHibernate()
+{
+    qCWarning(SOLID_POWER) << "Suspend-then-hibernate is not supported by the HAL backend";
+}
+
 void Solid::PowerManagement::reboot()
 {
-    Q_EMIT globalPowerManager->shuttingDown(); // yea :)
+    SOLID_EMIT_SIGNAL("shuttingDown", globalPowerManager->shuttingDown()); // yea :)
     globalPowerManager->makeHalCall(QStringLiteral("Reboot"));
 }
 
 void Solid::PowerManagement::shutdown()
 {
-    Q_EMIT globalPowerManager->shuttingDown(); // yea :)
+    SOLID_EMIT_SIGNAL("shuttingDown", globalPowerManager->shuttingDown()); // yea :)
     globalPowerManager->makeHalCall(QStringLiteral("Shutdown"));
 }
 
@@ -21,11 +21,14 @@
 #ifndef SOLID_POWER_HAL_P_H
 #define SOLID_POWER_HAL_P_H
 
-#include <QDBusInterface>
+#include <QDBusPendingCallWatcher>
+#include <QHash>
 #include <QLoggingCategory>
 
 #include "powermanagement.h"
 
+#include <atomic>
+
 Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
 
 struct ChangeDescription
@@ -44,24 +47,38 @@ public:
     PowerManagementPrivate();
     ~PowerManagementPrivate();
 
-    bool checkHalProperty(const QString &prop);
+    void checkHalProperty(const QString &prop);
+    void requestHalProperty(const QString &path, const QString &prop);
     void makeHalCall(const QString & method, int param = 0);
+    void applyHalProperty(const QString &path, const QString &prop, bool value);
 
 public Q_SLOTS:
     void init();
     void slotLidButtonPressed(const QString & type = QStringLiteral("ButtonPressed"), const QString &reason = QString());
     void slotPropertyModified(int count, const QList<ChangeDescription> &changes);
 
+private Q_SLOTS:
+    void slotHalPropertyReply(QDBusPendingCallWatcher *watcher);
+    void slotMethodNamesReply(QDBusPendingCallWatcher *watcher);
+    void slotLidFound(QDBusPendingCallWatcher *watcher);
+
 public:
-    QDBusInterface halComputer;
-    QDBusInterface halPowerManagement;
-    QDBusInterface halManager;
-    QDBusInterface * lidIface = Q_NULLPTR;
     QString lidPath;
-    bool hasLid = false;
-    bool isLidClosed = false;
-    bool powerSaveMode = false;
-    QSet<Solid::PowerManagement::SleepState> supportedSleepStates;
+    // written from the thread processing the bus signals, read from any
+    std::atomic<bool> hasLid {false};
+    std::atomic<bool> isLidClosed {false};
+    std::atomic<bool> powerSaveMode {false};
+    std::atomic<bool> canReboot {false};
+    std::atomic<bool> canShutdown {false};
+    std::atomic<int> supportedSleepStates {0}; // SleepState flags
+
+private:
+    struct PendingRead {
+        QDBusPendingCallWatcher *watcher;
+        bool stale; // another change arrived while the read was in flight
+    };
+    // in-flight property re-reads, keyed by device path and property name
+    QHash<QString, PendingRead> pendingReads;
 };
 }
 
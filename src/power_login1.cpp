@@ -21,12 +21,23 @@
 #include <QString>
 #include <QGlobalStatic>
 #include <QDebug>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDBusReply>
+#include <QMetaMethod>
 
 #include <future>
 
 #include "powermanagement.h"
 #include "power_login1_p.h"
+#include "powerstate_p.h"
+#include "aggregator_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "powertrace_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
+#include "wakeupreport_p.h"
 
 Q_LOGGING_CATEGORY(SOLID_POWER, "solid.power.login1")
 
@@ -46,71 +57,326 @@ Q_LOGGING_CATEGORY(SOLID_POWER, "solid.power.login1")
 
 Q_GLOBAL_STATIC(Solid::PowerManagementPrivate, globalPowerManager)
 
-bool checkLogin1Call(const QString &method)
+// the Can* answers only change with the system's configuration, or across a suspend
+#define CAPABILITY_CACHE_TIMEOUT 300000
+
+bool checkLogin1Call(const QString &method, bool *fresh = nullptr)
 {
+    ServiceHealth *health = ServiceHealth::forService(LOGIN1_SERVICE);
+    if (!health->allowCall()) {
+        return health->lastValue(method, false).toBool();
+    }
+
+    DiagnosticsPrivate::CallTimer timer(LOGIN1_SERVICE, method);
     QDBusMessage msg = QDBusMessage::createMethodCall(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method);
-    QDBusReply<QString> reply = QDBusConnection::systemBus().asyncCall(msg);
+    QDBusReply<QString> reply = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+    timer.setFailed(!reply.isValid());
     if (reply.isValid()) {
         //qCDebug(SOLID_POWER) << method << reply.value();
-        return (reply == QStringLiteral("yes") || reply == QStringLiteral("challenge"));
+        const bool result = (reply == QStringLiteral("yes") || reply == QStringLiteral("challenge"));
+        PowerTrace::recordReply(PowerTrace::Login1ReplyRecord, method, result);
+        health->recordSuccess();
+        health->setLastValue(method, result);
+        if (fresh) {
+            *fresh = true;
+        }
+        return result;
     } else {
         qCWarning(SOLID_POWER) << method << reply.error().name() << reply.error().message();
+        health->recordFailure(reply.error());
     }
-    return false;
+    return health->lastValue(method, false).toBool();
 }
 
 bool checkUPowerProperty(const QString &name)
 {
+    ServiceHealth *health = ServiceHealth::forService(UPOWER_SERVICE);
+    if (!health->allowCall()) {
+        return health->lastValue(name, false).toBool();
+    }
+
+    DiagnosticsPrivate::CallTimer timer(UPOWER_SERVICE, QStringLiteral("Get ") + name);
     QDBusMessage msg = QDBusMessage::createMethodCall(UPOWER_SERVICE, UPOWER_PATH, DBUS_PROPS_IFACE, QStringLiteral("Get"));
     msg << UPOWER_IFACE;
     msg << name;
-    QDBusReply<QVariant> reply = QDBusConnection::systemBus().asyncCall(msg);
+    QDBusReply<QVariant> reply = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+    timer.setFailed(!reply.isValid());
     if (reply.isValid()) {
-        return reply.value().toBool();
+        const bool result = reply.value().toBool();
+        PowerTrace::recordReply(PowerTrace::UPowerReplyRecord, name, result);
+        health->recordSuccess();
+        health->setLastValue(name, result);
+        return result;
     } else {
         qCWarning(SOLID_POWER) << name << reply.error().name() << reply.error().message();
+        health->recordFailure(reply.error());
     }
-    return false;
+    return health->lastValue(name, false).toBool();
 }
 
 // private
 Solid::PowerManagementPrivate::PowerManagementPrivate()
 {
-    QMetaObject::invokeMethod(this, "init");
+    // the bus signals get subscribed to on demand, see updateSubscriptions()
+    if (PowerTrace::isReplaying()) {
+        // created before moving to the I/O thread, so that it follows
+        replayer = new PowerTrace::Replayer([this](const PowerTrace::Record &record) {
+            replayRecord(record);
+        }, this);
+    }
+    if (IoThread::isEnabled()) {
+        IoThread::adopt(this);
+    }
+    if (replayer) {
+        QMetaObject::invokeMethod(replayer, "start", Qt::QueuedConnection);
+    }
 }
 
 Solid::PowerManagementPrivate::~PowerManagementPrivate()
 {
+    IoThread::shutdown();
+}
+
+bool Solid::PowerManagementPrivate::login1Capability(const QString &method)
+{
+    if (replayer) {
+        // only what the trace answered, login1 isn't asked
+        QMutexLocker locker(&capabilityMutex);
+        return capabilities.value(method, false);
+    }
+
+    {
+        QMutexLocker locker(&capabilityMutex);
+        if (capabilityAge.isValid() && capabilityAge.elapsed() > CAPABILITY_CACHE_TIMEOUT) {
+            if (IoThread::home()) {
+                // keep answering from the cache while it gets refreshed
+                capabilityAge.restart();
+                QMetaObject::invokeMethod(this, "refreshCapabilities", Qt::QueuedConnection);
+            } else {
+                capabilities.clear();
+                capabilityAge.invalidate();
+            }
+        }
+        const auto it = capabilities.constFind(method);
+        if (it != capabilities.constEnd()) {
+            return it.value();
+        }
+    }
+
+    // only real answers get cached, not the fallbacks of a hung login1
+    bool fresh = false;
+    const bool result = std::async(std::launch::async, [&method, &fresh]() {
+        return checkLogin1Call(method, &fresh);
+    }).get();
+    if (fresh) {
+        QMutexLocker locker(&capabilityMutex);
+        if (!capabilityAge.isValid()) {
+            capabilityAge.start();
+        }
+        capabilities.insert(method, result);
+    }
+    return result;
+}
+
+void Solid::PowerManagementPrivate::invalidateCapabilities()
+{
+    QMutexLocker locker(&capabilityMutex);
+    capabilities.clear();
+    capabilityAge.invalidate();
+}
+
+void Solid::PowerManagementPrivate::refreshCapabilities()
+{
+    QStringList methods;
+    {
+        QMutexLocker locker(&capabilityMutex);
+        methods = capabilities.keys();
+    }
+
+    ServiceHealth *health = ServiceHealth::forService(LOGIN1_SERVICE);
+    for (const QString &method : methods) {
+        if (!health->allowCall()) {
+            return;
+        }
+        QDBusMessage msg = QDBusMessage::createMethodCall(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method);
+        const QDBusPendingCall call = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+        DiagnosticsPrivate::trackPendingCall(LOGIN1_SERVICE, method, call);
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, method, health](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+            QDBusPendingReply<QString> reply = *watcher;
+            if (reply.isValid()) {
+                const bool result = (reply.value() == QStringLiteral("yes") || reply.value() == QStringLiteral("challenge"));
+                PowerTrace::recordReply(PowerTrace::Login1ReplyRecord, method, result);
+                health->recordSuccess();
+                health->setLastValue(method, result);
+                QMutexLocker locker(&capabilityMutex);
+                // unless dropped meanwhile, e.g. on resume
+                if (capabilities.contains(method)) {
+                    capabilities.insert(method, result);
+                }
+            } else {
+                qCWarning(SOLID_POWER) << method << reply.error().name() << reply.error().message();
+                health->recordFailure(reply.error());
+            }
+        });
+    }
 }
 
 void Solid::PowerManagementPrivate::makeLogin1Call(const QString &method)
 {
+    if (replayer) {
+        qCDebug(SOLID_POWER) << "Not making Login1 call while replaying:" << method;
+        return;
+    }
     qCDebug(SOLID_POWER) << "Making Login1 call:" << method;
     QDBusMessage msg = QDBusMessage::createMethodCall(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method);
     msg << true; // interactive
-    QDBusConnection::systemBus().asyncCall(msg);
+    DiagnosticsPrivate::trackPendingCall(LOGIN1_SERVICE, method, QDBusConnection::systemBus().asyncCall(msg));
+}
+
+void Solid::PowerManagementPrivate::ensureUPowerState()
+{
+    if (upowerPinned && upowerSubscribed) {
+        return;
+    }
+    upowerPinned = true;
+    updateSubscriptions();
+}
+
+void Solid::PowerManagementPrivate::replayRecord(const PowerTrace::Record &record)
+{
+    switch (record.type) {
+    case PowerTrace::UPowerChangeRecord:
+        upowerPropertiesChanged(UPOWER_IFACE, record.properties, QStringList());
+        break;
+    case PowerTrace::PrepareForSleepRecord:
+        login1Resuming(record.value);
+        break;
+    case PowerTrace::PrepareForShutdownRecord:
+        login1ShuttingDown(record.value);
+        break;
+    case PowerTrace::Login1ReplyRecord: {
+        QMutexLocker locker(&capabilityMutex);
+        capabilities.insert(record.name, record.value);
+        break;
+    }
+    case PowerTrace::UPowerReplyRecord:
+        if (record.name == PROP_ON_BATTERY) {
+            powerSaveStatus = record.value;
+        } else if (record.name == PROP_HAS_LID) {
+            hasLid = record.value;
+        } else if (record.name == PROP_LID_CLOSED) {
+            isLidClosed = record.value;
+        }
+        break;
+    }
 }
 
-void Solid::PowerManagementPrivate::init()
+void Solid::PowerManagementPrivate::connectNotify(const QMetaMethod &signal)
 {
-    // setup notifier signals
+    Notifier::connectNotify(signal);
+    if (isSubscriptionSignal(signal)) {
+        updateSubscriptions();
+    }
+}
+
+void Solid::PowerManagementPrivate::disconnectNotify(const QMetaMethod &signal)
+{
+    Notifier::disconnectNotify(signal);
+    // an invalid method means everything got disconnected at once
+    if (!signal.isValid() || isSubscriptionSignal(signal)) {
+        updateSubscriptions();
+    }
+}
+
+bool Solid::PowerManagementPrivate::isSubscriptionSignal(const QMetaMethod &signal) const
+{
+    // QtDBus connects to our destroyed() signal while we subscribe, that one must not recurse
+    return signal == QMetaMethod::fromSignal(&Notifier::appShouldConserveResourcesChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::isLidClosedChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::stateChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::aboutToSuspend) ||
+           signal == QMetaMethod::fromSignal(&Notifier::resumingFromSuspend) ||
+           signal == QMetaMethod::fromSignal(&Notifier::shuttingDown);
+}
+
+void Solid::PowerManagementPrivate::updateSubscriptions()
+{
+    if (replayer) {
+        // the trace is all there is
+        return;
+    }
+
+    QMutexLocker locker(&subscriptionMutex);
     auto conn = QDBusConnection::systemBus();
-    conn.connect(UPOWER_SERVICE, UPOWER_PATH, DBUS_PROPS_IFACE,
-                 QStringLiteral("PropertiesChanged"),
-                 this, SLOT(upowerPropertiesChanged(QString, QVariantMap, QStringList))
-                );
-
-    conn.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
-                 QStringLiteral("PrepareForSleep"),
-                 this, SLOT(login1Resuming(bool))
-                );
-
-    conn.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
-                 QStringLiteral("PrepareForShutdown"),
-                 this, SLOT(login1ShuttingDown(bool))
-                );
-
-    // fill properties
+
+    // arg0 is the interface of PropertiesChanged, let the bus daemon filter out the devices' ones
+    const QStringList upowerMatch = QStringList() << UPOWER_IFACE;
+    const bool wantUPower = upowerPinned ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::appShouldConserveResourcesChanged)) ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::isLidClosedChanged)) ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::stateChanged));
+    Aggregator::SharedState shared;
+    const UPowerSource wantedSource = !wantUPower ? NoSource : Aggregator::read(shared) ? AggregatorSource : BusSource;
+    if (wantedSource != upowerSource) {
+        if (upowerSource == BusSource) {
+            conn.disconnect(UPOWER_SERVICE, UPOWER_PATH, DBUS_PROPS_IFACE,
+                            QStringLiteral("PropertiesChanged"), upowerMatch, QString(),
+                            this, SLOT(upowerPropertiesChanged(QString, QVariantMap, QStringList)));
+        } else if (upowerSource == AggregatorSource) {
+            aggregatorWatcher.reset();
+        }
+
+        if (wantedSource == BusSource) {
+            SOLID_TRACE_SCOPE("init", QStringLiteral("PowerManagementPrivate::subscribe UPower"));
+            conn.connect(UPOWER_SERVICE, UPOWER_PATH, DBUS_PROPS_IFACE,
+                         QStringLiteral("PropertiesChanged"), upowerMatch, QString(),
+                         this, SLOT(upowerPropertiesChanged(QString, QVariantMap, QStringList)));
+            // fetched after subscribing, so that no change gets lost in between
+            fetchUPowerProperties();
+        } else if (wantedSource == AggregatorSource) {
+            aggregatorWatcher.reset(new Aggregator::Watcher([this]() {
+                QMetaObject::invokeMethod(this, "sharedStateChanged", Qt::QueuedConnection);
+            }));
+            applySharedState();
+        }
+        upowerSource = wantedSource;
+    }
+    upowerSubscribed = upowerSource != NoSource;
+
+    const bool wantSleep = isSignalConnected(QMetaMethod::fromSignal(&Notifier::aboutToSuspend)) ||
+                           isSignalConnected(QMetaMethod::fromSignal(&Notifier::resumingFromSuspend));
+    if (wantSleep != sleepSubscribed) {
+        if (wantSleep) {
+            conn.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
+                         QStringLiteral("PrepareForSleep"),
+                         this, SLOT(login1Resuming(bool)));
+        } else {
+            conn.disconnect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
+                            QStringLiteral("PrepareForSleep"),
+                            this, SLOT(login1Resuming(bool)));
+        }
+        sleepSubscribed = wantSleep;
+    }
+
+    const bool wantShutdown = isSignalConnected(QMetaMethod::fromSignal(&Notifier::shuttingDown));
+    if (wantShutdown != shutdownSubscribed) {
+        if (wantShutdown) {
+            conn.connect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
+                         QStringLiteral("PrepareForShutdown"),
+                         this, SLOT(login1ShuttingDown(bool)));
+        } else {
+            conn.disconnect(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE,
+                            QStringLiteral("PrepareForShutdown"),
+                            this, SLOT(login1ShuttingDown(bool)));
+        }
+        shutdownSubscribed = wantShutdown;
+    }
+}
+
+void Solid::PowerManagementPrivate::fetchUPowerProperties()
+{
     auto ps = std::async(std::launch::async, checkUPowerProperty, PROP_ON_BATTERY);
     auto hl = std::async(std::launch::async, checkUPowerProperty, PROP_HAS_LID);
     auto lc = std::async(std::launch::async, checkUPowerProperty, PROP_LID_CLOSED);
@@ -120,8 +386,42 @@ void Solid::PowerManagementPrivate::init()
     isLidClosed = lc.get();
 }
 
-Solid::PowerManagement::Notifier::Notifier()
+bool Solid::PowerManagementPrivate::applySharedState(Solid::PowerManagement::ChangedFlags *changes)
+{
+    Aggregator::SharedState shared;
+    if (!Aggregator::read(shared)) {
+        return false;
+    }
+
+    const bool onBattery = shared.flags & Aggregator::OnBattery;
+    const bool closed = shared.flags & Aggregator::LidClosed;
+    hasLid = shared.flags & Aggregator::HasLid;
+    if (powerSaveStatus.exchange(onBattery) != onBattery && changes) {
+        *changes |= Solid::PowerManagement::ConserveResourcesChanged;
+    }
+    if (isLidClosed.exchange(closed) != closed && changes) {
+        *changes |= Solid::PowerManagement::LidClosedChanged;
+    }
+    return true;
+}
+
+void Solid::PowerManagementPrivate::sharedStateChanged()
 {
+    Solid::PowerManagement::ChangedFlags changes;
+    if (!applySharedState(&changes)) {
+        // the aggregator went away, back to the bus
+        updateSubscriptions();
+        return;
+    }
+
+    DiagnosticsPrivate::signalReceived();
+    if (changes & Solid::PowerManagement::ConserveResourcesChanged) {
+        SOLID_EMIT_SIGNAL("appShouldConserveResourcesChanged", appShouldConserveResourcesChanged(powerSaveStatus));
+    }
+    if (changes & Solid::PowerManagement::LidClosedChanged) {
+        SOLID_EMIT_SIGNAL("isLidClosedChanged", isLidClosedChanged(isLidClosed));
+    }
+    Solid::PowerManagement::PowerStatePrivate::notify(changes);
 }
 
 Solid::PowerManagement::Notifier *Solid::PowerManagement::notifier()
@@ -129,68 +429,134 @@ Solid::PowerManagement::Notifier *Solid::PowerManagement::notifier()
     return globalPowerManager;
 }
 
+void Solid::PowerManagement::PowerStatePrivate::fillBackendState(PowerStatePrivate *d)
+{
+    d->conserveResources = globalPowerManager->powerSaveStatus;
+    d->hasLid = globalPowerManager->hasLid;
+    d->lidClosed = globalPowerManager->isLidClosed;
+}
+
 void Solid::PowerManagementPrivate::upowerPropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated)
 {
     Q_UNUSED(invalidated)
+    DiagnosticsPrivate::signalReceived();
     if (interface != UPOWER_IFACE) {
         return;
     }
+    PowerTrace::recordUPowerChange(changedProperties);
 
+    Solid::PowerManagement::ChangedFlags changes;
     if (changedProperties.contains(PROP_ON_BATTERY)) {
-        powerSaveStatus = changedProperties.value(PROP_ON_BATTERY).toBool();
-        Q_EMIT appShouldConserveResourcesChanged(powerSaveStatus);
+        const bool onBattery = changedProperties.value(PROP_ON_BATTERY).toBool();
+        if (powerSaveStatus.exchange(onBattery) != onBattery) {
+            changes |= Solid::PowerManagement::ConserveResourcesChanged;
+        }
+        SOLID_EMIT_SIGNAL("appShouldConserveResourcesChanged", appShouldConserveResourcesChanged(onBattery));
     }
     if (changedProperties.contains(PROP_LID_CLOSED)) {
-        isLidClosed = changedProperties.value(PROP_LID_CLOSED).toBool();
-        Q_EMIT isLidClosedChanged(isLidClosed);
+        const bool closed = changedProperties.value(PROP_LID_CLOSED).toBool();
+        if (isLidClosed.exchange(closed) != closed) {
+            changes |= Solid::PowerManagement::LidClosedChanged;
+        }
+        SOLID_EMIT_SIGNAL("isLidClosedChanged", isLidClosedChanged(closed));
     }
+    // one batch, one notification
+    Solid::PowerManagement::PowerStatePrivate::notify(changes);
 }
 
 void Solid::PowerManagementPrivate::login1Resuming(bool active)
 {
+    PowerTrace::recordSignal(PowerTrace::PrepareForSleepRecord, active);
+    DiagnosticsPrivate::signalReceived();
+    // a replayed sleep isn't a real one: this machine's wakeup sources and
+    // capabilities are left alone, the latter being the trace's answers anyway
     if (active) {
-        Q_EMIT aboutToSuspend();
+        if (!replayer) {
+            WakeupReportPrivate::captureBefore();
+        }
+        SOLID_EMIT_SIGNAL("aboutToSuspend", aboutToSuspend());
     } else {
-        Q_EMIT resumingFromSuspend();
+        if (!replayer) {
+            WakeupReportPrivate::captureAfter();
+            // the hardware may have changed meanwhile, e.g. docked or undocked
+            invalidateCapabilities();
+        }
+        SOLID_EMIT_SIGNAL("resumingFromSuspend", resumingFromSuspend());
     }
 }
 
 void Solid::PowerManagementPrivate::login1ShuttingDown(bool active)
 {
+    PowerTrace::recordSignal(PowerTrace::PrepareForShutdownRecord, active);
+    DiagnosticsPrivate::signalReceived();
     if (active) {
-        Q_EMIT shuttingDown();
+        SOLID_EMIT_SIGNAL("shuttingDown", shuttingDown());
     }
 }
 
 // public
 bool Solid::PowerManagement::appShouldConserveResources()
 {
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::OnBattery;
+    }
+    globalPowerManager->ensureUPowerState();
     return globalPowerManager->powerSaveStatus;
 }
 
 bool Solid::PowerManagement::canSuspend()
 {
-    return std::async(std::launch::async, checkLogin1Call, QStringLiteral("CanSuspend")).get();
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanSuspend;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanSuspend"));
 }
 
 bool Solid::PowerManagement::canHibernate()
 {
-    return std::async(std::launch::async, checkLogin1Call, QStringLiteral("CanHibernate")).get();
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanHibernate;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanHibernate"));
 }
 
 bool Solid::PowerManagement::canHybridSleep()
 {
-    return std::async(std::launch::async, checkLogin1Call, QStringLiteral("CanHybridSleep")).get();
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanHybridSleep;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanHybridSleep"));
+}
+
+bool Solid::PowerManagement::canSuspendThenHibernate()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanSuspendThenHibernate;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanSuspendThenHibernate"));
 }
 
 bool Solid::PowerManagement::canReboot()
 {
-    return std::async(std::launch::async, checkLogin1Call, QStringLiteral("CanReboot")).get();
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanReboot;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanReboot"));
 }
 
 bool Solid::PowerManagement::canShutdown()
 {
-    return std::async(std::launch::async, checkLogin1Call, QStringLiteral("CanPowerOff")).get();
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanShutdown;
+    }
+    return globalPowerManager->login1Capability(QStringLiteral("CanPowerOff"));
 }
 
 QSet<Solid::PowerManagement::SleepState> Solid::PowerManagement::supportedSleepStates()
@@ -205,6 +571,9 @@ QSet<Solid::PowerManagement::SleepState> Solid::PowerManagement::supportedSleepS
     if (canHybridSleep()) {
         result += Solid::PowerManagement::HybridSuspendState;
     }
+    if (canSuspendThenHibernate()) {
+        result += Solid::PowerManagement::SuspendThenHibernateState;
+    }
     return result;
 }
 
@@ -223,6 +592,11 @@ void Solid::PowerManagement::hybridSleep()
     globalPowerManager->makeLogin1Call(QStringLiteral("HybridSleep"));
 }
 
+void Solid::PowerManagement::suspendThenHibernate()
+{
+    globalPowerManager->makeLogin1Call(QStringLiteral("SuspendThenHibernate"));
+}
+
 void Solid::PowerManagement::reboot()
 {
     globalPowerManager->makeLogin1Call(QStringLiteral("Reboot"));
@@ -246,6 +620,9 @@ void Solid::PowerManagement::requestSleep(Solid::PowerManagement::SleepState sta
     case Solid::PowerManagement::HybridSuspendState:
         hybridSleep();
         break;
+    case Solid::PowerManagement::SuspendThenHibernateState:
+        suspendThenHibernate();
+        break;
     default:
         qCWarning(SOLID_POWER) << Q_FUNC_INFO << "Unsupported sleep state requested" << state;
     }
@@ -253,10 +630,20 @@ void Solid::PowerManagement::requestSleep(Solid::PowerManagement::SleepState sta
 
 bool Solid::PowerManagement::hasLid()
 {
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::HasLid;
+    }
+    globalPowerManager->ensureUPowerState();
     return globalPowerManager->hasLid;
 }
 
 bool Solid::PowerManagement::isLidClosed()
 {
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::LidClosed;
+    }
+    globalPowerManager->ensureUPowerState();
     return globalPowerManager->isLidClosed;
 }
@@ -22,10 +22,27 @@
 #define SOLID_POWER_LOGIN1_P_H
 
 #include <QDBusInterface>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QLoggingCategory>
+#include <QMutex>
 
 #include "powermanagement.h"
 
+#include <atomic>
+#include <memory>
+
+namespace Aggregator
+{
+class Watcher;
+}
+
+namespace PowerTrace
+{
+class Replayer;
+struct Record;
+}
+
 Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
 
 namespace Solid
@@ -39,17 +56,61 @@ public:
 
     void makeLogin1Call(const QString &method);
 
+    // the answer to one of login1's Can* methods, cached
+    bool login1Capability(const QString &method);
+    void invalidateCapabilities();
+
+    // makes sure the UPower properties are tracked, for the getters
+    void ensureUPowerState();
+
+protected:
+    void connectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+    void disconnectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+
 public Q_SLOTS:
-    void init();
     void upowerPropertiesChanged(const QString& interface, const QVariantMap& changedProperties, const QStringList& invalidated);
     void login1Resuming(bool active);
     void login1ShuttingDown(bool active);
+    void sharedStateChanged();
+
+private Q_SLOTS:
+    // asks login1 again for the cached Can* answers, without blocking
+    void refreshCapabilities();
 
 public:
-    bool powerSaveStatus = false;
-    bool hasLid = false;
-    bool isLidClosed = false;
+    // written from the thread processing the bus signals, read from any
+    std::atomic<bool> powerSaveStatus {false};
+    std::atomic<bool> hasLid {false};
+    std::atomic<bool> isLidClosed {false};
+
+private:
+    bool isSubscriptionSignal(const QMetaMethod &signal) const;
+    void updateSubscriptions();
+    void fetchUPowerProperties();
+    // feeds one record of a trace being replayed, instead of the bus
+    void replayRecord(const PowerTrace::Record &record);
+    bool applySharedState(Solid::PowerManagement::ChangedFlags *changes = nullptr);
+
+    // the bus signals are only subscribed to while somebody listens to ours
+    QMutex subscriptionMutex;
+    std::atomic<bool> upowerPinned {false}; // the getters were used, keep tracking for good
+    std::atomic<bool> upowerSubscribed {false};
+    enum UPowerSource {
+        NoSource,
+        BusSource,
+        AggregatorSource // the session aggregator's shared memory
+    };
+    UPowerSource upowerSource = NoSource;
+    std::unique_ptr<Aggregator::Watcher> aggregatorWatcher;
+    bool sleepSubscribed = false;
+    bool shutdownSubscribed = false;
     QSet<Solid::PowerManagement::SleepState> supportedSleepStates;
+
+    QMutex capabilityMutex;
+    QHash<QString, bool> capabilities;
+    QElapsedTimer capabilityAge;
+
+    PowerTrace::Replayer *replayer = nullptr; // SOLID_POWER_REPLAY
 };
 }
 
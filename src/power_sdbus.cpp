@@ -0,0 +1,812 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QGlobalStatic>
+#include <QMetaMethod>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+
+#include <poll.h>
+
+#include "powermanagement.h"
+#include "power_sdbus_p.h"
+#include "powerstate_p.h"
+#include "aggregator_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "powertrace_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
+#include "wakeupreport_p.h"
+
+Q_LOGGING_CATEGORY(SOLID_POWER, "solid.power.sdbus")
+
+#define UPOWER_SERVICE "org.freedesktop.UPower"
+#define UPOWER_PATH "/org/freedesktop/UPower"
+#define UPOWER_IFACE "org.freedesktop.UPower"
+
+#define LOGIN1_SERVICE "org.freedesktop.login1"
+#define LOGIN1_PATH "/org/freedesktop/login1"
+#define LOGIN1_IFACE "org.freedesktop.login1.Manager"
+
+#define PROP_ON_BATTERY "OnBattery"
+#define PROP_HAS_LID "LidIsPresent"
+#define PROP_LID_CLOSED "LidIsClosed"
+
+#define DBUS_PROPS_IFACE "org.freedesktop.DBus.Properties"
+
+// the Can* answers only change with the system's configuration, or across a suspend
+#define CAPABILITY_CACHE_TIMEOUT 300000
+
+// arg0 is the interface of PropertiesChanged, let the bus daemon filter out the devices' ones
+#define UPOWER_MATCH "type='signal',sender='" UPOWER_SERVICE "',path='" UPOWER_PATH "'," \
+                     "interface='" DBUS_PROPS_IFACE "',member='PropertiesChanged',arg0='" UPOWER_IFACE "'"
+#define SLEEP_MATCH "type='signal',sender='" LOGIN1_SERVICE "',path='" LOGIN1_PATH "'," \
+                    "interface='" LOGIN1_IFACE "',member='PrepareForSleep'"
+#define SHUTDOWN_MATCH "type='signal',sender='" LOGIN1_SERVICE "',path='" LOGIN1_PATH "'," \
+                       "interface='" LOGIN1_IFACE "',member='PrepareForShutdown'"
+#define OWNER_MATCH(service) "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus'," \
+                             "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='" service "'"
+
+Q_GLOBAL_STATIC(Solid::PowerManagementPrivate, globalPowerManager)
+
+// the circuit breakers, reset by our own owner watches instead of QtDBus
+static ServiceHealth *serviceHealth(const char *service)
+{
+    return ServiceHealth::forUnwatchedService(QLatin1String(service));
+}
+
+// private
+Solid::PowerManagementPrivate::PowerManagementPrivate()
+{
+    if (PowerTrace::isRecording() || PowerTrace::isReplaying()) {
+        qCWarning(SOLID_POWER) << "Recording and replaying are only supported by the login1 backend, ignoring SOLID_POWER_RECORD and SOLID_POWER_REPLAY";
+    }
+    const int r = sd_bus_open_system(&bus);
+    if (r < 0) {
+        qCWarning(SOLID_POWER) << "Cannot connect to the system bus:" << strerror(-r);
+        bus = nullptr;
+        return;
+    }
+
+    // the bus is processed from the event loop of the thread we live in
+    IoThread::adopt(this);
+    QMetaObject::invokeMethod(this, "init", Qt::QueuedConnection);
+}
+
+Solid::PowerManagementPrivate::~PowerManagementPrivate()
+{
+    IoThread::shutdown();
+    sd_bus_slot_unref(upowerSlot);
+    sd_bus_slot_unref(sleepSlot);
+    sd_bus_slot_unref(shutdownSlot);
+    sd_bus_slot_unref(ownerSlots[0]);
+    sd_bus_slot_unref(ownerSlots[1]);
+    if (bus) {
+        sd_bus_flush_close_unref(bus);
+    }
+    if (callBus) {
+        sd_bus_flush_close_unref(callBus);
+    }
+}
+
+void Solid::PowerManagementPrivate::init()
+{
+    const int fd = sd_bus_get_fd(bus);
+    readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(readNotifier, &QSocketNotifier::activated, this, &PowerManagementPrivate::processBus);
+    writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+    writeNotifier->setEnabled(false);
+    connect(writeNotifier, &QSocketNotifier::activated, this, &PowerManagementPrivate::processBus);
+    timeoutTimer = new QTimer(this);
+    timeoutTimer->setSingleShot(true);
+    connect(timeoutTimer, &QTimer::timeout, this, &PowerManagementPrivate::processBus);
+
+    // a restarted service gets a fresh chance, as the circuit breakers would with QtDBus
+    {
+        QMutexLocker locker(&busMutex);
+        const char *rules[] = { OWNER_MATCH(LOGIN1_SERVICE), OWNER_MATCH(UPOWER_SERVICE) };
+        for (int i = 0; i < 2; ++i) {
+            const int r = sd_bus_add_match(bus, &ownerSlots[i], rules[i], &PowerManagementPrivate::serviceOwnerChanged, this);
+            if (r < 0) {
+                qCWarning(SOLID_POWER) << "Cannot subscribe to" << rules[i] << strerror(-r);
+                ownerSlots[i] = nullptr;
+            }
+        }
+    }
+
+    // whatever got queued before we were watching
+    processBus();
+}
+
+void Solid::PowerManagementPrivate::processBus()
+{
+    {
+        QMutexLocker locker(&busMutex);
+        int r;
+        do {
+            r = sd_bus_process(bus, nullptr);
+        } while (r > 0);
+        if (r < 0) {
+            qCWarning(SOLID_POWER) << "Processing the bus failed:" << strerror(-r);
+        }
+        updateWatches();
+    }
+    emitPending();
+}
+
+void Solid::PowerManagementPrivate::updateWatches()
+{
+    if (!readNotifier) {
+        return;
+    }
+
+    const int events = sd_bus_get_events(bus);
+    writeNotifier->setEnabled(events > 0 && (events & POLLOUT));
+
+    uint64_t deadline;
+    if (sd_bus_get_timeout(bus, &deadline) >= 0 && deadline != UINT64_MAX) {
+        // an absolute CLOCK_MONOTONIC time, in usecs
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const uint64_t now = uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        timeoutTimer->start(deadline > now ? int(qMin<uint64_t>((deadline - now + 999) / 1000, INT_MAX)) : 0);
+    } else {
+        timeoutTimer->stop();
+    }
+}
+
+void Solid::PowerManagementPrivate::emitPending()
+{
+    // the signals are emitted without holding the bus, receivers may well query us
+    QList<PendingEvent> events;
+    Solid::PowerManagement::ChangedFlags changes;
+    bool onBatterySignal, lidSignal;
+    {
+        QMutexLocker locker(&busMutex);
+        events.swap(pendingEvents);
+        changes = pendingChanges;
+        pendingChanges = Solid::PowerManagement::ChangedFlags();
+        onBatterySignal = pendingOnBatterySignal;
+        lidSignal = pendingLidSignal;
+        pendingOnBatterySignal = pendingLidSignal = false;
+    }
+
+    if (onBatterySignal) {
+        SOLID_EMIT_SIGNAL("appShouldConserveResourcesChanged", appShouldConserveResourcesChanged(powerSaveStatus));
+    }
+    if (lidSignal) {
+        SOLID_EMIT_SIGNAL("isLidClosedChanged", isLidClosedChanged(isLidClosed));
+    }
+    Solid::PowerManagement::PowerStatePrivate::notify(changes);
+
+    Q_FOREACH (PendingEvent event, events) {
+        switch (event) {
+        case AboutToSuspendEvent:
+            WakeupReportPrivate::captureBefore();
+            SOLID_EMIT_SIGNAL("aboutToSuspend", aboutToSuspend());
+            break;
+        case ResumingEvent:
+            WakeupReportPrivate::captureAfter();
+            // the hardware may have changed meanwhile, e.g. docked or undocked
+            invalidateCapabilities();
+            SOLID_EMIT_SIGNAL("resumingFromSuspend", resumingFromSuspend());
+            break;
+        case ShuttingDownEvent:
+            SOLID_EMIT_SIGNAL("shuttingDown", shuttingDown());
+            break;
+        }
+    }
+}
+
+int Solid::PowerManagementPrivate::upowerPropertiesChanged(sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(error)
+    PowerManagementPrivate *d = static_cast<PowerManagementPrivate *>(userdata);
+    DiagnosticsPrivate::signalReceived();
+
+    // the strings point into the message, nothing gets copied
+    const char *interface;
+    if (sd_bus_message_read(message, "s", &interface) < 0 || strcmp(interface, UPOWER_IFACE) != 0) {
+        return 0;
+    }
+    if (sd_bus_message_enter_container(message, SD_BUS_TYPE_ARRAY, "{sv}") <= 0) {
+        return 0;
+    }
+    while (sd_bus_message_enter_container(message, SD_BUS_TYPE_DICT_ENTRY, "sv") > 0) {
+        const char *name;
+        if (sd_bus_message_read(message, "s", &name) < 0) {
+            break;
+        }
+        const bool onBattery = strcmp(name, PROP_ON_BATTERY) == 0;
+        const bool lidClosed = strcmp(name, PROP_LID_CLOSED) == 0;
+        int value;
+        if ((onBattery || lidClosed) && sd_bus_message_enter_container(message, SD_BUS_TYPE_VARIANT, "b") > 0) {
+            if (sd_bus_message_read(message, "b", &value) >= 0) {
+                if (onBattery) {
+                    if (d->powerSaveStatus.exchange(value) != bool(value)) {
+                        d->pendingChanges |= Solid::PowerManagement::ConserveResourcesChanged;
+                    }
+                    d->pendingOnBatterySignal = true;
+                } else {
+                    if (d->isLidClosed.exchange(value) != bool(value)) {
+                        d->pendingChanges |= Solid::PowerManagement::LidClosedChanged;
+                    }
+                    d->pendingLidSignal = true;
+                }
+            }
+            sd_bus_message_exit_container(message);
+        } else {
+            sd_bus_message_skip(message, "v");
+        }
+        sd_bus_message_exit_container(message);
+    }
+    sd_bus_message_exit_container(message);
+    return 0;
+}
+
+int Solid::PowerManagementPrivate::login1PrepareForSleep(sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(error)
+    PowerManagementPrivate *d = static_cast<PowerManagementPrivate *>(userdata);
+    DiagnosticsPrivate::signalReceived();
+    int active;
+    if (sd_bus_message_read(message, "b", &active) >= 0) {
+        d->pendingEvents.append(active ? AboutToSuspendEvent : ResumingEvent);
+    }
+    return 0;
+}
+
+int Solid::PowerManagementPrivate::login1PrepareForShutdown(sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(error)
+    PowerManagementPrivate *d = static_cast<PowerManagementPrivate *>(userdata);
+    DiagnosticsPrivate::signalReceived();
+    int active;
+    if (sd_bus_message_read(message, "b", &active) >= 0 && active) {
+        d->pendingEvents.append(ShuttingDownEvent);
+    }
+    return 0;
+}
+
+int Solid::PowerManagementPrivate::serviceOwnerChanged(sd_bus_message *message, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(userdata)
+    Q_UNUSED(error)
+    const char *name, *oldOwner, *newOwner;
+    if (sd_bus_message_read(message, "sss", &name, &oldOwner, &newOwner) >= 0 && *newOwner) {
+        serviceHealth(name)->reset();
+    }
+    return 0;
+}
+
+bool Solid::PowerManagementPrivate::callBoolMethod(const char *service, const char *path, const char *interface, const char *method, const char *property, bool *result)
+{
+    ServiceHealth *health = serviceHealth(service);
+    if (!health->allowCall()) {
+        return false;
+    }
+
+    const QString name = property ? QStringLiteral("Get ") + QLatin1String(property) : QLatin1String(method);
+    DiagnosticsPrivate::CallTimer timer(QLatin1String(service), name);
+    sd_bus_message *request = nullptr;
+    sd_bus_message *reply = nullptr;
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    int r;
+    {
+        // not the signals' connection: holding busMutex for up to the timeout would delay
+        // PrepareForSleep; this one never has anything else to process
+        QMutexLocker locker(&callMutex);
+        if (!callBus) {
+            r = sd_bus_open_system(&callBus);
+            if (r < 0) {
+                qCWarning(SOLID_POWER) << "Cannot connect to the system bus:" << strerror(-r);
+                callBus = nullptr;
+                timer.setFailed();
+                return false;
+            }
+        }
+        r = sd_bus_message_new_method_call(callBus, &request, service, path, interface, method);
+        if (r >= 0 && property) {
+            r = sd_bus_message_append(request, "ss", UPOWER_IFACE, property);
+        }
+        if (r >= 0) {
+            r = sd_bus_call(callBus, request, uint64_t(health->timeout()) * 1000, &error, &reply);
+        }
+    }
+
+    if (r >= 0) {
+        if (property) {
+            int value;
+            r = sd_bus_message_read(reply, "v", "b", &value);
+            if (r >= 0) {
+                *result = value;
+            }
+        } else {
+            // the Can* methods answer "yes", "no", "challenge" or "na"
+            const char *answer;
+            r = sd_bus_message_read(reply, "s", &answer);
+            *result = r >= 0 && (strcmp(answer, "yes") == 0 || strcmp(answer, "challenge") == 0);
+        }
+    }
+
+    if (r < 0) {
+        qCWarning(SOLID_POWER) << name << (error.name ? error.name : "") << (error.message ? error.message : strerror(-r));
+        timer.setFailed();
+        health->recordFailure(r == -ETIMEDOUT);
+    } else {
+        health->recordSuccess();
+    }
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(reply);
+    sd_bus_message_unref(request);
+    return r >= 0;
+}
+
+bool Solid::PowerManagementPrivate::checkLogin1Call(const char *method)
+{
+    const QString key = QLatin1String(method);
+    bool expired = false;
+    bool cached = false;
+    bool cachedResult = false;
+    {
+        QMutexLocker locker(&capabilityMutex);
+        if (capabilityAge.isValid() && capabilityAge.elapsed() > CAPABILITY_CACHE_TIMEOUT) {
+            if (IoThread::home()) {
+                // keep answering from the cache while it gets refreshed
+                capabilityAge.restart();
+                expired = true;
+            } else {
+                capabilities.clear();
+                capabilityAge.invalidate();
+            }
+        }
+        const auto it = capabilities.constFind(key);
+        if (it != capabilities.constEnd()) {
+            cached = true;
+            cachedResult = it.value();
+        }
+    }
+    if (expired) {
+        refreshCapabilities();
+    }
+    if (cached) {
+        return cachedResult;
+    }
+
+    ServiceHealth *health = serviceHealth(LOGIN1_SERVICE);
+    bool result = false;
+    if (callBoolMethod(LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method, nullptr, &result)) {
+        health->setLastValue(key, result);
+        // only real answers get cached, not the fallbacks of a hung login1
+        QMutexLocker locker(&capabilityMutex);
+        if (!capabilityAge.isValid()) {
+            capabilityAge.start();
+        }
+        capabilities.insert(key, result);
+        return result;
+    }
+    return health->lastValue(QLatin1String(method), false).toBool();
+}
+
+void Solid::PowerManagementPrivate::invalidateCapabilities()
+{
+    QMutexLocker locker(&capabilityMutex);
+    capabilities.clear();
+    capabilityAge.invalidate();
+}
+
+struct CapabilityCall
+{
+    Solid::PowerManagementPrivate *d;
+    QString method;
+    DiagnosticsPrivate::CallStats *stats;
+    struct timespec start;
+};
+
+int Solid::PowerManagementPrivate::capabilityRefreshed(sd_bus_message *reply, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(error)
+    CapabilityCall *call = static_cast<CapabilityCall *>(userdata);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const qint64 usecs = (now.tv_sec - call->start.tv_sec) * 1000000 + (now.tv_nsec - call->start.tv_nsec) / 1000;
+
+    ServiceHealth *health = serviceHealth(LOGIN1_SERVICE);
+    const char *answer;
+    int r = sd_bus_message_is_method_error(reply, nullptr) ? -sd_bus_message_get_errno(reply) : 0;
+    if (r >= 0) {
+        r = sd_bus_message_read(reply, "s", &answer);
+    }
+    call->stats->record(quint64(qMax<qint64>(usecs, 0)), r < 0);
+    if (r >= 0) {
+        const bool result = strcmp(answer, "yes") == 0 || strcmp(answer, "challenge") == 0;
+        health->recordSuccess();
+        health->setLastValue(call->method, result);
+        QMutexLocker locker(&call->d->capabilityMutex);
+        // unless dropped meanwhile, e.g. on resume
+        if (call->d->capabilities.contains(call->method)) {
+            call->d->capabilities.insert(call->method, result);
+        }
+    } else {
+        qCWarning(SOLID_POWER) << call->method << strerror(-r);
+        health->recordFailure(r == -ETIMEDOUT);
+    }
+    delete call;
+    return 0;
+}
+
+void Solid::PowerManagementPrivate::refreshCapabilities()
+{
+    QStringList methods;
+    {
+        QMutexLocker locker(&capabilityMutex);
+        methods = capabilities.keys();
+    }
+
+    ServiceHealth *health = serviceHealth(LOGIN1_SERVICE);
+    for (const QString &method : methods) {
+        if (!health->allowCall()) {
+            break;
+        }
+        CapabilityCall *call = new CapabilityCall;
+        call->d = this;
+        call->method = method;
+        call->stats = DiagnosticsPrivate::stats(QStringLiteral(LOGIN1_SERVICE), method);
+        clock_gettime(CLOCK_MONOTONIC, &call->start);
+
+        int r;
+        {
+            QMutexLocker locker(&busMutex);
+            // floating slot: owned by the bus, freed along with the reply
+            r = bus ? sd_bus_call_method_async(bus, nullptr, LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method.toLatin1().constData(),
+                                               capabilityRefreshed, call, "") : -ENOTCONN;
+        }
+        if (r < 0) {
+            qCWarning(SOLID_POWER) << method << strerror(-r);
+            call->stats->record(0, true);
+            delete call;
+            // back to asking on demand
+            invalidateCapabilities();
+            return;
+        }
+    }
+    // get the messages out, the replies come through processBus()
+    QMetaObject::invokeMethod(this, "processBus", Qt::QueuedConnection);
+}
+
+bool Solid::PowerManagementPrivate::checkUPowerProperty(const char *name)
+{
+    ServiceHealth *health = serviceHealth(UPOWER_SERVICE);
+    bool result = false;
+    if (callBoolMethod(UPOWER_SERVICE, UPOWER_PATH, DBUS_PROPS_IFACE, "Get", name, &result)) {
+        health->setLastValue(QLatin1String(name), result);
+        return result;
+    }
+    return health->lastValue(QLatin1String(name), false).toBool();
+}
+
+struct AsyncCall
+{
+    DiagnosticsPrivate::CallStats *stats;
+    struct timespec start;
+};
+
+static int asyncCallDone(sd_bus_message *reply, void *userdata, sd_bus_error *error)
+{
+    Q_UNUSED(error)
+    AsyncCall *call = static_cast<AsyncCall *>(userdata);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const qint64 usecs = (now.tv_sec - call->start.tv_sec) * 1000000 + (now.tv_nsec - call->start.tv_nsec) / 1000;
+    call->stats->record(quint64(qMax<qint64>(usecs, 0)), sd_bus_message_is_method_error(reply, nullptr));
+    delete call;
+    return 0;
+}
+
+void Solid::PowerManagementPrivate::makeLogin1Call(const char *method)
+{
+    qCDebug(SOLID_POWER) << "Making Login1 call:" << method;
+    AsyncCall *call = new AsyncCall;
+    call->stats = DiagnosticsPrivate::stats(QStringLiteral(LOGIN1_SERVICE), QLatin1String(method));
+    clock_gettime(CLOCK_MONOTONIC, &call->start);
+
+    int r;
+    {
+        QMutexLocker locker(&busMutex);
+        // floating slot: owned by the bus, freed along with the reply
+        r = bus ? sd_bus_call_method_async(bus, nullptr, LOGIN1_SERVICE, LOGIN1_PATH, LOGIN1_IFACE, method,
+                                           asyncCallDone, call, "b", 1 /* interactive */) : -ENOTCONN;
+    }
+    if (r < 0) {
+        qCWarning(SOLID_POWER) << method << strerror(-r);
+        call->stats->record(0, true);
+        delete call;
+        return;
+    }
+    // get the message out, the reply comes through processBus()
+    QMetaObject::invokeMethod(this, "processBus", Qt::QueuedConnection);
+}
+
+void Solid::PowerManagementPrivate::ensureUPowerState()
+{
+    if (upowerPinned && upowerSubscribed) {
+        return;
+    }
+    upowerPinned = true;
+    updateSubscriptions();
+}
+
+void Solid::PowerManagementPrivate::connectNotify(const QMetaMethod &signal)
+{
+    Notifier::connectNotify(signal);
+    if (isSubscriptionSignal(signal)) {
+        updateSubscriptions();
+    }
+}
+
+void Solid::PowerManagementPrivate::disconnectNotify(const QMetaMethod &signal)
+{
+    Notifier::disconnectNotify(signal);
+    // an invalid method means everything got disconnected at once
+    if (!signal.isValid() || isSubscriptionSignal(signal)) {
+        updateSubscriptions();
+    }
+}
+
+bool Solid::PowerManagementPrivate::isSubscriptionSignal(const QMetaMethod &signal) const
+{
+    return signal == QMetaMethod::fromSignal(&Notifier::appShouldConserveResourcesChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::isLidClosedChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::stateChanged) ||
+           signal == QMetaMethod::fromSignal(&Notifier::aboutToSuspend) ||
+           signal == QMetaMethod::fromSignal(&Notifier::resumingFromSuspend) ||
+           signal == QMetaMethod::fromSignal(&Notifier::shuttingDown);
+}
+
+// adds or removes one match rule, depending on whether it's wanted
+static void updateMatch(sd_bus *bus, sd_bus_slot **slot, bool wanted, const char *rule, sd_bus_message_handler_t callback, void *userdata)
+{
+    if (wanted == (*slot != nullptr)) {
+        return;
+    }
+    if (wanted) {
+        const int r = sd_bus_add_match(bus, slot, rule, callback, userdata);
+        if (r < 0) {
+            qCWarning(SOLID_POWER) << "Cannot subscribe to" << rule << strerror(-r);
+            *slot = nullptr;
+        }
+    } else {
+        *slot = sd_bus_slot_unref(*slot);
+    }
+}
+
+void Solid::PowerManagementPrivate::updateSubscriptions()
+{
+    QMutexLocker locker(&subscriptionMutex);
+    if (!bus) {
+        return;
+    }
+
+    const bool wantUPower = upowerPinned ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::appShouldConserveResourcesChanged)) ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::isLidClosedChanged)) ||
+                            isSignalConnected(QMetaMethod::fromSignal(&Notifier::stateChanged));
+    const bool wantSleep = isSignalConnected(QMetaMethod::fromSignal(&Notifier::aboutToSuspend)) ||
+                           isSignalConnected(QMetaMethod::fromSignal(&Notifier::resumingFromSuspend));
+    const bool wantShutdown = isSignalConnected(QMetaMethod::fromSignal(&Notifier::shuttingDown));
+
+    bool fetch;
+    {
+        QMutexLocker busLocker(&busMutex);
+        fetch = wantUPower && !upowerSlot;
+        updateMatch(bus, &upowerSlot, wantUPower, UPOWER_MATCH, &PowerManagementPrivate::upowerPropertiesChanged, this);
+        updateMatch(bus, &sleepSlot, wantSleep, SLEEP_MATCH, &PowerManagementPrivate::login1PrepareForSleep, this);
+        updateMatch(bus, &shutdownSlot, wantShutdown, SHUTDOWN_MATCH, &PowerManagementPrivate::login1PrepareForShutdown, this);
+    }
+    QMetaObject::invokeMethod(this, "processBus", Qt::QueuedConnection);
+
+    if (fetch) {
+        // fetched after subscribing, so that no change gets lost in between
+        SOLID_TRACE_SCOPE("init", QStringLiteral("PowerManagementPrivate::subscribe UPower"));
+        fetchUPowerProperties();
+    }
+    upowerSubscribed = upowerSlot != nullptr;
+}
+
+void Solid::PowerManagementPrivate::fetchUPowerProperties()
+{
+    // one connection, so no point in parallel calls
+    powerSaveStatus = checkUPowerProperty(PROP_ON_BATTERY);
+    hasLid = checkUPowerProperty(PROP_HAS_LID);
+    isLidClosed = checkUPowerProperty(PROP_LID_CLOSED);
+}
+
+Solid::PowerManagement::Notifier *Solid::PowerManagement::notifier()
+{
+    return globalPowerManager;
+}
+
+void Solid::PowerManagement::PowerStatePrivate::fillBackendState(PowerStatePrivate *d)
+{
+    d->conserveResources = globalPowerManager->powerSaveStatus;
+    d->hasLid = globalPowerManager->hasLid;
+    d->lidClosed = globalPowerManager->isLidClosed;
+}
+
+// public
+bool Solid::PowerManagement::appShouldConserveResources()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::OnBattery;
+    }
+    globalPowerManager->ensureUPowerState();
+    return globalPowerManager->powerSaveStatus;
+}
+
+bool Solid::PowerManagement::canSuspend()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanSuspend;
+    }
+    return globalPowerManager->checkLogin1Call("CanSuspend");
+}
+
+bool Solid::PowerManagement::canHibernate()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanHibernate;
+    }
+    return globalPowerManager->checkLogin1Call("CanHibernate");
+}
+
+bool Solid::PowerManagement::canHybridSleep()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanHybridSleep;
+    }
+    return globalPowerManager->checkLogin1Call("CanHybridSleep");
+}
+
+bool Solid::PowerManagement::canSuspendThenHibernate()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanSuspendThenHibernate;
+    }
+    return globalPowerManager->checkLogin1Call("CanSuspendThenHibernate");
+}
+
+bool Solid::PowerManagement::canReboot()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanReboot;
+    }
+    return globalPowerManager->checkLogin1Call("CanReboot");
+}
+
+bool Solid::PowerManagement::canShutdown()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::CanShutdown;
+    }
+    return globalPowerManager->checkLogin1Call("CanPowerOff");
+}
+
+QSet<Solid::PowerManagement::SleepState> Solid::PowerManagement::supportedSleepStates()
+{
+    QSet<Solid::PowerManagement::SleepState> result;
+    if (canSuspend()) {
+        result += Solid::PowerManagement::SuspendState;
+    }
+    if (canHibernate()) {
+        result += Solid::PowerManagement::HibernateState;
+    }
+    if (canHybridSleep()) {
+        result += Solid::PowerManagement::HybridSuspendState;
+    }
+    if (canSuspendThenHibernate()) {
+        result += Solid::PowerManagement::SuspendThenHibernateState;
+    }
+    return result;
+}
+
+void Solid::PowerManagement::suspend()
+{
+    globalPowerManager->makeLogin1Call("Suspend");
+}
+
+void Solid::PowerManagement::hibernate()
+{
+    globalPowerManager->makeLogin1Call("Hibernate");
+}
+
+void Solid::PowerManagement::hybridSleep()
+{
+    globalPowerManager->makeLogin1Call("HybridSleep");
+}
+
+void Solid::PowerManagement::suspendThenHibernate()
+{
+    globalPowerManager->makeLogin1Call("SuspendThenHibernate");
+}
+
+void Solid::PowerManagement::reboot()
+{
+    globalPowerManager->makeLogin1Call("Reboot");
+}
+
+void Solid::PowerManagement::shutdown()
+{
+    globalPowerManager->makeLogin1Call("PowerOff");
+}
+
+void Solid::PowerManagement::requestSleep(Solid::PowerManagement::SleepState state)
+{
+    switch (state) {
+    case Solid::PowerManagement::SuspendState:
+    case Solid::PowerManagement::StandbyState:
+        suspend();
+        break;
+    case Solid::PowerManagement::HibernateState:
+        hibernate();
+        break;
+    case Solid::PowerManagement::HybridSuspendState:
+        hybridSleep();
+        break;
+    case Solid::PowerManagement::SuspendThenHibernateState:
+        suspendThenHibernate();
+        break;
+    default:
+        qCWarning(SOLID_POWER) << Q_FUNC_INFO << "Unsupported sleep state requested" << state;
+    }
+}
+
+bool Solid::PowerManagement::hasLid()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::HasLid;
+    }
+    globalPowerManager->ensureUPowerState();
+    return globalPowerManager->hasLid;
+}
+
+bool Solid::PowerManagement::isLidClosed()
+{
+    Aggregator::SharedState shared;
+    if (Aggregator::read(shared)) {
+        return shared.flags & Aggregator::LidClosed;
+    }
+    globalPowerManager->ensureUPowerState();
+    return globalPowerManager->isLidClosed;
+}
@@ -0,0 +1,133 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_SDBUS_P_H
+#define SOLID_POWER_SDBUS_P_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+
+#include "powermanagement.h"
+
+#include <atomic>
+
+#include <systemd/sd-bus.h>
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+class QSocketNotifier;
+class QTimer;
+
+namespace Solid
+{
+/*
+ * The login1/UPower backend on top of libsystemd's sd-bus, for small agents
+ * that should stay light: one private system bus connection, processed from
+ * the event loop of the thread the backend lives in, and messages read in
+ * place instead of being demarshalled into QVariants. The blocking calls go
+ * through a second connection, so that they don't hold up the signals.
+ */
+class PowerManagementPrivate : public PowerManagement::Notifier
+{
+    Q_OBJECT
+public:
+    PowerManagementPrivate();
+    ~PowerManagementPrivate();
+
+    // blocking, callable from any thread; false on failure
+    bool callBoolMethod(const char *service, const char *path, const char *interface, const char *method, const char *property, bool *result);
+    // for login1's Can* methods, whose answers are cached
+    bool checkLogin1Call(const char *method);
+    void invalidateCapabilities();
+    bool checkUPowerProperty(const char *name);
+    void makeLogin1Call(const char *method);
+
+    // makes sure the UPower properties are tracked, for the getters
+    void ensureUPowerState();
+
+protected:
+    void connectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+    void disconnectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void init();
+    void processBus();
+
+public:
+    // written from the thread processing the bus, read from any
+    std::atomic<bool> powerSaveStatus {false};
+    std::atomic<bool> hasLid {false};
+    std::atomic<bool> isLidClosed {false};
+
+private:
+    static int upowerPropertiesChanged(sd_bus_message *message, void *userdata, sd_bus_error *error);
+    static int login1PrepareForSleep(sd_bus_message *message, void *userdata, sd_bus_error *error);
+    static int login1PrepareForShutdown(sd_bus_message *message, void *userdata, sd_bus_error *error);
+    static int capabilityRefreshed(sd_bus_message *reply, void *userdata, sd_bus_error *error);
+    static int serviceOwnerChanged(sd_bus_message *message, void *userdata, sd_bus_error *error);
+
+    bool isSubscriptionSignal(const QMetaMethod &signal) const;
+    void updateSubscriptions();
+    void fetchUPowerProperties();
+    void updateWatches();
+    void emitPending();
+    // asks login1 again for the cached Can* answers, without blocking
+    void refreshCapabilities();
+
+    // sd-bus isn't thread-safe, all uses of the connection go through this
+    QMutex busMutex;
+    sd_bus *bus = nullptr;
+    QSocketNotifier *readNotifier = nullptr;
+    QSocketNotifier *writeNotifier = nullptr;
+    QTimer *timeoutTimer = nullptr;
+
+    // for callBoolMethod(), opened on first use
+    QMutex callMutex;
+    sd_bus *callBus = nullptr;
+
+    // the bus signals are only subscribed to while somebody listens to ours
+    QMutex subscriptionMutex;
+    std::atomic<bool> upowerPinned {false};
+    std::atomic<bool> upowerSubscribed {false};
+    sd_bus_slot *upowerSlot = nullptr;
+    sd_bus_slot *sleepSlot = nullptr;
+    sd_bus_slot *shutdownSlot = nullptr;
+    sd_bus_slot *ownerSlots[2] = { nullptr, nullptr }; // login1, UPower
+
+    // collected while processing, emitted once the bus is unlocked again
+    Solid::PowerManagement::ChangedFlags pendingChanges;
+    bool pendingOnBatterySignal = false;
+    bool pendingLidSignal = false;
+    enum PendingEvent {
+        AboutToSuspendEvent,
+        ResumingEvent,
+        ShuttingDownEvent
+    };
+    QList<PendingEvent> pendingEvents;
+
+    QMutex capabilityMutex;
+    QHash<QString, bool> capabilities;
+    QElapsedTimer capabilityAge;
+};
+}
+
+#endif
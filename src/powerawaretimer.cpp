@@ -0,0 +1,231 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "powerawaretimer.h"
+#include "powerawaretimer_p.h"
+#include "powermanagement.h"
+
+#include <QElapsedTimer>
+#include <QGlobalStatic>
+#include <QTimer>
+
+// the boundaries timeouts get aligned to, the largest one fitting in the slack wins
+static const int s_alignments[] = { 100, 250, 500, 1000, 2000, 5000, 10000, 30000, 60000 };
+
+static std::atomic<quint64> s_wakeupsSaved {0};
+
+// only the timers of one thread share its wakeups
+static thread_local qint64 s_lastBoundary = -1;
+
+Q_GLOBAL_STATIC(TimerPowerState, globalTimerPowerState)
+
+// the monotonic clock, which is the same for all processes: they align to the same boundaries
+static qint64 monotonicNow()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock.msecsSinceReference();
+}
+
+TimerPowerState::TimerPowerState()
+{
+    Solid::PowerManagement::Notifier *notifier = Solid::PowerManagement::notifier();
+    connect(notifier, &Solid::PowerManagement::Notifier::appShouldConserveResourcesChanged, this, [this](bool conserve) {
+        conserving = conserve;
+    }, Qt::DirectConnection);
+    connect(notifier, &Solid::PowerManagement::Notifier::isLidClosedChanged, this, [this](bool closed) {
+        lidClosed = closed;
+    }, Qt::DirectConnection);
+
+    // after connecting, so that no change is missed
+    conserving = Solid::PowerManagement::appShouldConserveResources();
+    lidClosed = Solid::PowerManagement::isLidClosed();
+}
+
+TimerPowerState *TimerPowerState::instance()
+{
+    return globalTimerPowerState;
+}
+
+PowerAwareTimerPrivate::PowerAwareTimerPrivate(Solid::PowerAwareTimer *q)
+    : q(q)
+    , timer(new QTimer(q))
+{
+    timer->setSingleShot(true);
+}
+
+int PowerAwareTimerPrivate::slack() const
+{
+    const TimerPowerState *state = TimerPowerState::instance();
+    if (!state) {
+        return 0;
+    }
+
+    int result = 0;
+    if (state->lidClosed) {
+        result = interval / 2;
+    } else if (state->conserving) {
+        result = interval / 4;
+    }
+    if (maxSlack >= 0) {
+        result = qMin(result, maxSlack);
+    }
+    return result;
+}
+
+void PowerAwareTimerPrivate::arm()
+{
+    const int allowed = slack();
+    int alignment = 0;
+    for (int candidate : s_alignments) {
+        if (candidate <= allowed) {
+            alignment = candidate;
+        }
+    }
+
+    qint64 due = nextDue;
+    if (alignment > 0) {
+        due = (nextDue + alignment - 1) / alignment * alignment;
+        armedAt = due;
+        // the boundary has to be hit exactly for the other timers to share the wakeup
+        timer->setTimerType(Qt::PreciseTimer);
+    } else {
+        armedAt = -1;
+        timer->setTimerType(timerType);
+    }
+    timer->start(int(qMax<qint64>(0, due - monotonicNow())));
+}
+
+void PowerAwareTimerPrivate::fired()
+{
+    if (armedAt >= 0) {
+        if (armedAt == s_lastBoundary) {
+            ++s_wakeupsSaved;
+        } else {
+            s_lastBoundary = armedAt;
+        }
+    }
+
+    if (singleShot) {
+        armedAt = -1;
+    } else {
+        // from the nominal time, so that the slack doesn't accumulate
+        nextDue += interval;
+        const qint64 now = monotonicNow();
+        if (nextDue <= now) {
+            // overslept, e.g. through a suspend: no burst of timeouts to catch up
+            nextDue = now + interval;
+        }
+        arm();
+    }
+
+    Q_EMIT q->timeout();
+}
+
+Solid::PowerAwareTimer::PowerAwareTimer(QObject *parent)
+    : QObject(parent)
+    , d(new PowerAwareTimerPrivate(this))
+{
+    connect(d->timer, &QTimer::timeout, this, [this]() {
+        d->fired();
+    });
+}
+
+Solid::PowerAwareTimer::~PowerAwareTimer()
+{
+    delete d;
+}
+
+int Solid::PowerAwareTimer::interval() const
+{
+    return d->interval;
+}
+
+void Solid::PowerAwareTimer::setInterval(int msecs)
+{
+    d->interval = qMax(0, msecs);
+    // like QTimer, an active timer restarts
+    if (isActive()) {
+        start();
+    }
+}
+
+bool Solid::PowerAwareTimer::isSingleShot() const
+{
+    return d->singleShot;
+}
+
+void Solid::PowerAwareTimer::setSingleShot(bool singleShot)
+{
+    d->singleShot = singleShot;
+}
+
+Qt::TimerType Solid::PowerAwareTimer::timerType() const
+{
+    return d->timerType;
+}
+
+void Solid::PowerAwareTimer::setTimerType(Qt::TimerType type)
+{
+    d->timerType = type;
+}
+
+int Solid::PowerAwareTimer::maxSlack() const
+{
+    return d->maxSlack;
+}
+
+void Solid::PowerAwareTimer::setMaxSlack(int msecs)
+{
+    d->maxSlack = msecs;
+}
+
+int Solid::PowerAwareTimer::currentSlack() const
+{
+    return d->slack();
+}
+
+bool Solid::PowerAwareTimer::isActive() const
+{
+    return d->timer->isActive();
+}
+
+quint64 Solid::PowerAwareTimer::wakeupsSaved()
+{
+    return s_wakeupsSaved;
+}
+
+void Solid::PowerAwareTimer::start()
+{
+    d->nextDue = monotonicNow() + d->interval;
+    d->arm();
+}
+
+void Solid::PowerAwareTimer::start(int msecs)
+{
+    d->interval = qMax(0, msecs);
+    start();
+}
+
+void Solid::PowerAwareTimer::stop()
+{
+    d->timer->stop();
+    d->armedAt = -1;
+}
@@ -0,0 +1,125 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <solidpower_export.h>
+
+#ifndef SOLID_POWERAWARETIMER_H
+#define SOLID_POWERAWARETIMER_H
+
+#include <QObject>
+
+namespace Solid {
+
+class PowerAwareTimerPrivate;
+
+/**
+ * A timer that wakes the system up less often when it should save power.
+ *
+ * On AC power with the lid open, it behaves like a QTimer of timerType().
+ * While the application should conserve resources, its timeouts may come up
+ * to a quarter of the interval late, up to half of it with the lid closed,
+ * capped by maxSlack(). Within that slack window, the timeout is aligned to a
+ * boundary of the system's monotonic clock (e.g. a whole second), shared by
+ * all the timers of all the applications using this class: they wake up
+ * together instead of one after the other.
+ *
+ * Periodic timers keep their average rate, the slack is taken from each
+ * period and not accumulated.
+ *
+ * @since 5.x
+ */
+class SOLIDPOWER_EXPORT PowerAwareTimer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PowerAwareTimer(QObject *parent = Q_NULLPTR);
+    ~PowerAwareTimer();
+
+    /**
+     * @return the timeout interval in milliseconds, 0 by default
+     */
+    int interval() const;
+    void setInterval(int msecs);
+
+    /**
+     * @return whether the timer only fires once, false by default
+     */
+    bool isSingleShot() const;
+    void setSingleShot(bool singleShot);
+
+    /**
+     * @return the accuracy of the timer when not saving power, Qt::CoarseTimer by default
+     */
+    Qt::TimerType timerType() const;
+    void setTimerType(Qt::TimerType type);
+
+    /**
+     * @return the most a timeout may be delayed to save power in milliseconds,
+     * or -1 (the default) for no other limit than the fraction of the interval
+     */
+    int maxSlack() const;
+    void setMaxSlack(int msecs);
+
+    /**
+     * @return the slack applied to the timeouts right now in milliseconds, following
+     * the power state
+     */
+    int currentSlack() const;
+
+    /**
+     * @return whether the timer is running
+     */
+    bool isActive() const;
+
+    /**
+     * @return how many wakeups the timers of this process saved so far, by firing
+     * together with another one instead of on their own
+     */
+    static quint64 wakeupsSaved();
+
+public Q_SLOTS:
+    /**
+     * Starts or restarts the timer with the current interval.
+     */
+    void start();
+
+    /**
+     * Starts or restarts the timer with an interval of @p msecs milliseconds.
+     */
+    void start(int msecs);
+
+    /**
+     * Stops the timer.
+     */
+    void stop();
+
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the timer times out.
+     */
+    void timeout();
+
+private:
+    PowerAwareTimerPrivate *const d;
+};
+
+} // namespace Solid
+
+#endif
@@ -0,0 +1,68 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWERAWARETIMER_P_H
+#define SOLID_POWERAWARETIMER_P_H
+
+#include <QObject>
+
+#include "powerawaretimer.h"
+
+#include <atomic>
+
+class QTimer;
+
+/*
+ * The power state the timers adapt to, shared by all of them and updated
+ * from whatever thread the Notifier emits in.
+ */
+class TimerPowerState : public QObject
+{
+public:
+    TimerPowerState();
+
+    static TimerPowerState *instance();
+
+    std::atomic<bool> conserving {false};
+    std::atomic<bool> lidClosed {false};
+};
+
+class PowerAwareTimerPrivate
+{
+public:
+    explicit PowerAwareTimerPrivate(Solid::PowerAwareTimer *q);
+
+    // msecs of slack allowed right now
+    int slack() const;
+    // arms the underlying timer for the timeout due at nextDue
+    void arm();
+    void fired();
+
+    Solid::PowerAwareTimer *q;
+    QTimer *timer;
+    int interval = 0;
+    bool singleShot = false;
+    Qt::TimerType timerType = Qt::CoarseTimer;
+    int maxSlack = -1;
+    qint64 nextDue = 0; // on the monotonic clock, without slack
+    qint64 armedAt = -1; // the aligned boundary armed for, -1 when not aligned
+};
+
+#endif
@@ -22,8 +22,12 @@
 #ifndef SOLID_POWER_H
 #define SOLID_POWER_H
 
+#include <QList>
 #include <QObject>
 #include <QSet>
+#include <QSharedDataPointer>
+
+#include <functional>
 
 #include <solidpower_export.h>
 
@@ -62,7 +66,132 @@ enum SleepState {
      * but then, instead of powering down, the computer enters sleep mode
      * @since 4.11
      */
-    HybridSuspendState = 8
+    HybridSuspendState = 8,
+    /**
+     * The machine suspends first, and hibernates after a while if still suspended
+     * (or when the battery runs low), to avoid draining the battery overnight
+     * @since 5.x
+     */
+    SuspendThenHibernateState = 16
+};
+
+/**
+ * This enum type defines the kernel's variants of suspend to RAM (its mem_sleep modes),
+ * used by SuspendState.
+ * @since 5.x
+ */
+enum SuspendMode {
+    //! The mode could not be determined, or the kernel doesn't offer a choice
+    UnknownSuspendMode = 0,
+    //! Suspend-to-idle (s2idle): the processors idle with the devices suspended; fastest to resume, draws the most
+    SuspendToIdleMode = 1,
+    //! Power-on suspend (shallow, ACPI S1)
+    ShallowSuspendMode = 2,
+    //! Suspend-to-RAM (deep, ACPI S3): only the RAM stays powered; draws the least
+    DeepSuspendMode = 4
+};
+
+/**
+ * This enum type defines the different power profiles (performance states) of the system.
+ * @since 5.x
+ */
+enum PowerProfile {
+    //! The profile could not be determined
+    UnknownProfile = 0,
+    //! Reduced performance to save power (e.g. for longer battery life)
+    PowerSaverProfile = 1,
+    //! Balance between performance and power consumption, the usual default
+    BalancedProfile = 2,
+    //! Maximum performance, at the expense of power consumption
+    PerformanceProfile = 4
+};
+
+/**
+ * This enum type defines the levels of thermal pressure the system can be under.
+ * @since 5.x
+ */
+enum ThermalPressure {
+    //! All thermal zones are well below their trip points
+    NominalThermalPressure = 0,
+    //! Some thermal zone is approaching its passive trip point, throttling may start soon
+    ModerateThermalPressure = 1,
+    //! A passive trip point was reached or a processor cooling device is active, the system is throttling
+    HeavyThermalPressure = 2,
+    //! Some thermal zone is close to its hot or critical trip point, an emergency shutdown may follow
+    CriticalThermalPressure = 3
+};
+
+/**
+ * This enum type defines the parts of the power state that can change at once.
+ * @see Notifier::stateChanged()
+ * @since 5.x
+ */
+enum ChangedFlag {
+    //! The system switched between AC and battery power
+    ConserveResourcesChanged = 0x1,
+    //! The laptop's lid was opened or closed
+    LidClosedChanged = 0x2,
+    //! The active power profile changed
+    PowerProfileChanged = 0x4,
+    //! The thermal pressure crossed a level threshold
+    ThermalPressureChanged = 0x8
+};
+Q_DECLARE_FLAGS(ChangedFlags, ChangedFlag)
+
+class PowerStatePrivate;
+
+/**
+ * @brief The PowerState class
+ *
+ * An immutable snapshot of the power state of the system, as carried by Notifier::stateChanged().
+ * All the values were taken at the same time, so they are consistent with each other.
+ *
+ * PowerState is implicitly shared, copying it is cheap.
+ *
+ * @since 5.x
+ */
+class SOLIDPOWER_EXPORT PowerState
+{
+public:
+    /**
+     * Constructs a state with all the values at their defaults.
+     */
+    PowerState();
+    PowerState(const PowerState &other);
+    ~PowerState();
+    PowerState &operator=(const PowerState &other);
+
+    /**
+     * @return whether apps should conserve power, i.e. whether the system runs on battery
+     * @see Solid::PowerManagement::appShouldConserveResources()
+     */
+    bool appShouldConserveResources() const;
+
+    /**
+     * @return whether the system has a lid
+     */
+    bool hasLid() const;
+
+    /**
+     * @return whether the lid is closed
+     */
+    bool isLidClosed() const;
+
+    /**
+     * @return the active power profile
+     */
+    PowerProfile powerProfile() const;
+
+    /**
+     * @return the thermal pressure
+     */
+    ThermalPressure thermalPressure() const;
+
+private:
+    friend class PowerStatePrivate;
+    explicit PowerState(PowerStatePrivate *dd);
+
+    QSharedDataPointer<PowerStatePrivate> d;
 };
 
 /**
@@ -96,6 +225,13 @@ SOLIDPOWER_EXPORT bool canHibernate();
   */
 SOLIDPOWER_EXPORT bool canHybridSleep();
 
+/**
+  * @return whether the system is able of suspending, then hibernating after a while
+  * @see SuspendThenHibernateState
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT bool canSuspendThenHibernate();
+
 /**
   * @return whether the system is able of rebooting (restarting the machine)
   * @since 5.x
@@ -116,6 +252,34 @@ SOLIDPOWER_EXPORT bool canShutdown();
  */
 SOLIDPOWER_EXPORT QSet<SleepState> supportedSleepStates();
 
+/**
+ * Retrieves the variants of suspend to RAM offered by the kernel (/sys/power/mem_sleep).
+ *
+ * @return the suspend modes supported by this system, empty if there's no choice
+ * @see suspendMode()
+ * @since 5.x
+ */
+SOLIDPOWER_EXPORT QSet<SuspendMode> supportedSuspendModes();
+
+/**
+ * @return the variant of suspend to RAM used by suspend(), and by suspendThenHibernate()
+ * for its first stage
+ * @since 5.x
+ */
+SOLIDPOWER_EXPORT SuspendMode suspendMode();
+
+/**
+ * Chooses the variant of suspend to RAM used from now on.
+ *
+ * This requires write access to /sys/power/mem_sleep. Note that the service manager may
+ * override it when suspending, if configured with a memory sleep mode of its own.
+ *
+ * @param mode one of supportedSuspendModes()
+ * @return whether the mode was changed
+ * @since 5.x
+ */
+SOLIDPOWER_EXPORT bool setSuspendMode(SuspendMode mode);
+
 /**
   * Tell the system to enter the suspend mode (aka sleep).
   *
@@ -152,6 +316,18 @@ SOLIDPOWER_EXPORT void hibernate();
   */
 SOLIDPOWER_EXPORT void hybridSleep();
 
+/**
+  * Tell the system to suspend, then to hibernate after a while
+  *
+  * For details see Solid::PowerManagement::SuspendThenHibernateState
+  *
+  * Emits the signal Notifier::aboutToSuspend() before, and
+  * Notifier::resumingFromSuspend() after.
+  *
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT void suspendThenHibernate();
+
 /**
   * Tell the system to reboot the machine.
   *
@@ -186,6 +362,9 @@ SOLIDPOWER_EXPORT void requestSleep(SleepState state);
  * @return a 'cookie' value representing the suppression request. Used by the power manager to
  * track the application's outstanding suppression requests. Returns -1 if the request was
  * denied.
+ *
+ * @note Since 5.x, the suppression survives the power manager restarting or being replaced by
+ * another one: it gets requested again, and the cookie remains valid.
  */
 SOLIDPOWER_EXPORT int beginSuppressingSleep(const QString &reason = QString());
 
@@ -241,6 +420,114 @@ SOLIDPOWER_EXPORT bool hasLid();
   */
 SOLIDPOWER_EXPORT bool isLidClosed();
 
+/**
+ * A source of system wakeups, as accounted by the kernel.
+ * @see WakeupReport
+ * @since 5.x
+ */
+struct WakeupSource
+{
+    //! The kernel's name for the source, e.g. a device ("PNP0C0D:00") or a timer ("alarmtimer")
+    QString name;
+    //! The number of events it signaled during the sleep
+    quint64 events = 0;
+    //! The number of them that aborted the suspend or woke the system up
+    quint64 wakeups = 0;
+};
+
+/**
+ * What happened during the last sleep, see lastWakeupReport().
+ * @since 5.x
+ */
+struct WakeupReport
+{
+    //! Whether there is a report, i.e. the library saw the system both suspending and resuming
+    bool isValid = false;
+    //! How long the system slept, in milliseconds
+    qint64 sleepDuration = 0;
+    //! The interrupt that woke the system up, or -1 when the kernel didn't record it
+    int wakeupIrq = -1;
+    //! The sources that signaled events during the sleep, the most active first
+    QList<WakeupSource> sources;
+};
+
+/**
+ * Reports what woke the system up from its last sleep, by comparing the kernel's wakeup
+ * source statistics (/sys/class/wakeup) from before and after it.
+ *
+ * The statistics are only read around a sleep, and only while the Notifier's suspend
+ * signals are connected to; the report is ready when Notifier::resumingFromSuspend() is
+ * emitted.
+ *
+ * @return the report about the last sleep, invalid if there's none
+ * @since 5.x
+ */
+SOLIDPOWER_EXPORT WakeupReport lastWakeupReport();
+
+/**
+  * Retrieves the currently active power profile.
+  *
+  * The value is cached and kept up to date from the power-profiles-daemon
+  * (net.hadess.PowerProfiles); when the daemon isn't running, it's derived from
+  * the cpufreq energy_performance_preference or scaling_governor settings.
+  *
+  * @return the active power profile
+  * @see Notifier::powerProfileChanged()
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT PowerProfile powerProfile();
+
+/**
+  * @return the set of power profiles that can be activated on this system
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT QSet<PowerProfile> supportedPowerProfiles();
+
+/**
+  * Requests a switch of the system-wide power profile.
+  *
+  * @param profile the profile to activate
+  * @return false if the request could not be sent (e.g. unsupported profile)
+  * @see Notifier::powerProfileChanged()
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT bool setPowerProfile(PowerProfile profile);
+
+/**
+  * Tell the power management subsystem to keep the given profile active until further notice,
+  * for example for the duration of a compile or render job. Only PerformanceProfile and
+  * PowerSaverProfile can be held.
+  *
+  * The hold is released when calling stopHoldingPowerProfile(), and also automatically when the
+  * application exits.
+  *
+  * @param profile the profile to hold
+  * @param reason Give a reason for holding the profile, to be used in giving user feedback
+  * @return a 'cookie' value representing the hold request, or -1 if the request was denied
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT int beginHoldingPowerProfile(PowerProfile profile, const QString &reason = QString());
+
+/**
+  * Tell the power management that a particular power profile hold is no longer needed.
+  * @param cookie The cookie acquired when requesting the hold
+  * @return true if the hold was released, false if an invalid cookie was given
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT bool stopHoldingPowerProfile(int cookie);
+
+/**
+  * Retrieves the current thermal pressure, derived from the temperatures and trip points
+  * of the thermal zones and the state of the cooling devices.
+  *
+  * Applications running heavy workloads should scale them back when the pressure rises.
+  *
+  * @return the current thermal pressure
+  * @see Notifier::thermalPressureChanged()
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT ThermalPressure thermalPressure();
+
 /**
  * @brief The Notifier class
  *
@@ -299,10 +586,127 @@ Q_SIGNALS:
      */
     void isLidClosedChanged(bool closed);
 
+    /**
+     * This signal is emitted when the active power profile changes
+     * @param profile the new power profile
+     * @see powerProfile()
+     *
+     * @since 5.x
+     */
+    void powerProfileChanged(Solid::PowerManagement::PowerProfile profile);
+
+    /**
+     * This signal is emitted when the thermal pressure crosses a level threshold.
+     *
+     * The thermal zones are only monitored while this signal is connected; the sampling
+     * rate adapts to how close the system is to its trip points.
+     *
+     * @param pressure the new thermal pressure
+     * @see thermalPressure()
+     *
+     * @since 5.x
+     */
+    void thermalPressureChanged(Solid::PowerManagement::ThermalPressure pressure);
+
+    /**
+     * This signal is emitted once for each batch of changes to the power state, after the signals
+     * for the individual properties, e.g. when a single bus message reports both the switch to
+     * battery power and the lid getting closed.
+     *
+     * Connecting to this signal enables the tracking of all the state, including the monitoring
+     * of the thermal zones.
+     *
+     * @param state a snapshot of the whole power state, after the changes
+     * @param changes which parts of the state changed
+     *
+     * @since 5.x
+     */
+    void stateChanged(const Solid::PowerManagement::PowerState &state, Solid::PowerManagement::ChangedFlags changes);
+
 protected:
     Notifier();
+
+    void connectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+    void disconnectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
+};
+
+/**
+  * Makes the library process the system bus signals on a private I/O thread, and emit the
+  * Notifier signals from there, so that a busy main thread doesn't delay them: aboutToSuspend()
+  * is of little use once the system has already suspended.
+  *
+  * The signals then reach each receiver in its own thread. Receivers connected with
+  * Qt::DirectConnection are called right away from the I/O thread, and have to be thread-safe.
+  *
+  * This has to be called before the first use of the library, it has no effect afterwards.
+  * Setting the environment variable SOLID_POWER_IO_THREAD to 1 has the same effect.
+  *
+  * @param enable whether to use the I/O thread, off by default
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT void setUseIoThread(bool enable);
+
+/**
+ * @brief The Event struct
+ *
+ * A power management event, as delivered by dispatchEvents().
+ *
+ * @since 5.x
+ */
+struct Event {
+    /**
+     * The kind of event, each one matching a Notifier signal.
+     */
+    enum Type {
+        //! Notifier::appShouldConserveResourcesChanged()
+        ConserveResourcesChangedEvent,
+        //! Notifier::resumingFromSuspend()
+        ResumingFromSuspendEvent,
+        //! Notifier::aboutToSuspend()
+        AboutToSuspendEvent,
+        //! Notifier::shuttingDown()
+        ShuttingDownEvent,
+        //! Notifier::isLidClosedChanged()
+        LidClosedChangedEvent,
+        //! Notifier::powerProfileChanged()
+        PowerProfileChangedEvent
+    };
+
+    //! what happened
+    Type type;
+    //! the power state right after the event
+    PowerState state;
 };
 
+/**
+  * Integrates the library with an event loop other than Qt's, e.g. in a daemon built around
+  * epoll or libuv, which doesn't run a QCoreApplication event loop.
+  *
+  * The library then processes the bus on its private I/O thread (see setUseIoThread()), and
+  * queues the events for the application. The returned file descriptor becomes readable while
+  * events are pending: add it to the event loop and call dispatchEvents() when it is.
+  *
+  * This has to be called before any other function of the library, and always returns the same
+  * descriptor. Thermal pressure changes are not queued, since tracking them requires polling;
+  * use thermalPressure() where needed.
+  *
+  * @return a pollable file descriptor, owned by the library; -1 on error
+  * @see dispatchEvents()
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT int eventFd();
+
+/**
+  * Delivers the events queued since the last call, in the calling thread, and resets the
+  * readiness of eventFd().
+  *
+  * @param handler called once for each pending event, in order
+  * @return the number of events delivered
+  * @see eventFd()
+  * @since 5.x
+  */
+SOLIDPOWER_EXPORT int dispatchEvents(const std::function<void(const Event &event)> &handler);
+
 /**
   * Provides access to the Notifier class
   */
@@ -310,4 +714,8 @@ SOLIDPOWER_EXPORT Notifier *notifier();
 }
 }
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(Solid::PowerManagement::ChangedFlags)
+Q_DECLARE_METATYPE(Solid::PowerManagement::PowerState)
+Q_DECLARE_METATYPE(Solid::PowerManagement::ChangedFlags)
+
 #endif
@@ -0,0 +1,538 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QGlobalStatic>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusReply>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+
+#include <future>
+
+#include "powermanagement.h"
+#include "powerprofiles_p.h"
+#include "powerstate_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+#include "servicehealth_p.h"
+#include "trace_p.h"
+
+#define PPD_SERVICE QStringLiteral("net.hadess.PowerProfiles")
+#define PPD_PATH QStringLiteral("/net/hadess/PowerProfiles")
+#define PPD_IFACE QStringLiteral("net.hadess.PowerProfiles")
+
+#define PROP_ACTIVE_PROFILE QStringLiteral("ActiveProfile")
+#define PROP_PROFILES QStringLiteral("Profiles")
+
+#define DBUS_PROPS_IFACE QStringLiteral("org.freedesktop.DBus.Properties")
+
+#define CPUFREQ_PATH QStringLiteral("/sys/devices/system/cpu/cpufreq")
+
+Q_GLOBAL_STATIC(PowerProfilesPrivate, globalPowerProfiles)
+
+using Solid::PowerManagement::PowerProfile;
+
+static QString profileToString(PowerProfile profile)
+{
+    switch (profile) {
+    case Solid::PowerManagement::PowerSaverProfile:
+        return QStringLiteral("power-saver");
+    case Solid::PowerManagement::BalancedProfile:
+        return QStringLiteral("balanced");
+    case Solid::PowerManagement::PerformanceProfile:
+        return QStringLiteral("performance");
+    default:
+        return QString();
+    }
+}
+
+static PowerProfile profileFromString(const QString &profile)
+{
+    if (profile == QStringLiteral("power-saver")) {
+        return Solid::PowerManagement::PowerSaverProfile;
+    } else if (profile == QStringLiteral("balanced")) {
+        return Solid::PowerManagement::BalancedProfile;
+    } else if (profile == QStringLiteral("performance")) {
+        return Solid::PowerManagement::PerformanceProfile;
+    }
+    return Solid::PowerManagement::UnknownProfile;
+}
+
+static QVariant getPPDProperty(const QString &name)
+{
+    ServiceHealth *health = ServiceHealth::forService(PPD_SERVICE);
+    if (!health->allowCall()) {
+        return health->lastValue(name);
+    }
+
+    QDBusMessage msg = QDBusMessage::createMethodCall(PPD_SERVICE, PPD_PATH, DBUS_PROPS_IFACE, QStringLiteral("Get"));
+    msg << PPD_IFACE;
+    msg << name;
+    DiagnosticsPrivate::CallTimer timer(PPD_SERVICE, QStringLiteral("Get ") + name);
+    QDBusReply<QVariant> reply = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+    timer.setFailed(!reply.isValid());
+    if (reply.isValid()) {
+        health->recordSuccess();
+        health->setLastValue(name, reply.value());
+        return reply.value();
+    } else if (reply.error().type() != QDBusError::ServiceUnknown) {
+        qCWarning(SOLID_POWER) << name << reply.error().name() << reply.error().message();
+        health->recordFailure(reply.error());
+        return health->lastValue(name);
+    }
+    return QVariant();
+}
+
+static QSet<PowerProfile> parseProfiles(const QVariant &value)
+{
+    // aa{sv}, each dict carries at least the "Profile" and "Driver" keys
+    QSet<PowerProfile> result;
+    const QDBusArgument arg = value.value<QDBusArgument>();
+    arg.beginArray();
+    while (!arg.atEnd()) {
+        QVariantMap entry;
+        arg >> entry;
+        const PowerProfile profile = profileFromString(entry.value(QStringLiteral("Profile")).toString());
+        if (profile != Solid::PowerManagement::UnknownProfile) {
+            result += profile;
+        }
+    }
+    arg.endArray();
+    return result;
+}
+
+static QStringList cpufreqPolicies()
+{
+    QStringList result;
+    const QStringList entries = QDir(CPUFREQ_PATH).entryList(QStringList() << QStringLiteral("policy*"), QDir::Dirs);
+    Q_FOREACH (const QString &entry, entries) {
+        result << CPUFREQ_PATH + QLatin1Char('/') + entry;
+    }
+    return result;
+}
+
+static QString readSysfsString(const QString &path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        return QString::fromLatin1(file.readAll().trimmed());
+    }
+    return QString();
+}
+
+static bool writeSysfsString(const QString &path, const QString &value)
+{
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly)) {
+        return file.write(value.toLatin1()) == value.size();
+    }
+    return false;
+}
+
+static void restoreSysfsProfile()
+{
+    // post routine: give back the profile that was active before our holds
+    PowerProfilesPrivate *d = PowerProfilesPrivate::instance();
+    if (d && !d->holds.isEmpty() && d->profileBeforeHolds != Solid::PowerManagement::UnknownProfile) {
+        PowerProfilesPrivate::writeSysfsProfile(d->profileBeforeHolds);
+    }
+}
+
+PowerProfilesPrivate::PowerProfilesPrivate()
+{
+    qRegisterMetaType<Solid::PowerManagement::PowerProfile>("Solid::PowerManagement::PowerProfile");
+
+    m_watcher = new QDBusServiceWatcher(PPD_SERVICE, QDBusConnection::systemBus(), QDBusServiceWatcher::WatchForOwnerChange, this);
+    connect(m_watcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &PowerProfilesPrivate::slotServiceOwnerChanged);
+
+    // we might be created from any thread, live in the library's one; the watcher moves along
+    IoThread::adopt(this);
+
+    QDBusConnection::systemBus().connect(PPD_SERVICE, PPD_PATH, DBUS_PROPS_IFACE,
+                                         QStringLiteral("PropertiesChanged"),
+                                         this, SLOT(ppdPropertiesChanged(QString, QVariantMap, QStringList)));
+
+    // not fetched right here: we might be created from within a connect(), see connectNotify();
+    // a query coming first fetches right away, see ensureInitialized()
+    QMetaObject::invokeMethod(this, "init", Qt::QueuedConnection);
+}
+
+PowerProfilesPrivate::~PowerProfilesPrivate()
+{
+}
+
+PowerProfilesPrivate *PowerProfilesPrivate::instance()
+{
+    return globalPowerProfiles;
+}
+
+bool PowerProfilesPrivate::exists()
+{
+    return globalPowerProfiles.exists();
+}
+
+void PowerProfilesPrivate::init()
+{
+    ensureInitialized();
+}
+
+void PowerProfilesPrivate::ensureInitialized()
+{
+    if (m_initialized) {
+        return;
+    }
+    refresh(false);
+}
+
+QSet<PowerProfile> PowerProfilesPrivate::supported() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_supportedProfiles;
+}
+
+bool PowerProfilesPrivate::isDaemonAvailable() const
+{
+    QMutexLocker locker(&m_stateMutex);
+    return m_daemonAvailable;
+}
+
+void PowerProfilesPrivate::refresh(bool notify)
+{
+    QMutexLocker refreshLocker(&m_refreshMutex);
+    if (!notify && m_initialized) {
+        // a query beat init() to it
+        return;
+    }
+    SOLID_TRACE_SCOPE("init", QStringLiteral("PowerProfilesPrivate::refresh"));
+
+    auto ap = std::async(std::launch::async, getPPDProperty, PROP_ACTIVE_PROFILE);
+    auto pr = std::async(std::launch::async, getPPDProperty, PROP_PROFILES);
+
+    const QVariant active = ap.get();
+    const QVariant profiles = pr.get();
+
+    const bool available = active.isValid();
+    QSet<PowerProfile> supportedProfiles;
+    PowerProfile current;
+    if (available) {
+        supportedProfiles = parseProfiles(profiles);
+        current = profileFromString(active.toString());
+    } else {
+        current = readSysfsProfile();
+        if (sysfsWritable()) {
+            supportedProfiles << Solid::PowerManagement::PowerSaverProfile << Solid::PowerManagement::BalancedProfile
+                              << Solid::PowerManagement::PerformanceProfile;
+        } else if (current != Solid::PowerManagement::UnknownProfile) {
+            supportedProfiles << current;
+        }
+    }
+
+    {
+        QMutexLocker locker(&m_stateMutex);
+        m_daemonAvailable = available;
+        m_supportedProfiles = supportedProfiles;
+    }
+    // before notifying, the receivers may well query us
+    m_initialized = true;
+    updateProfile(current, notify);
+}
+
+void PowerProfilesPrivate::updateProfile(PowerProfile newProfile, bool notify)
+{
+    if (newProfile != profile) {
+        profile = newProfile;
+        if (notify) {
+            SOLID_EMIT_SIGNAL("powerProfileChanged", Solid::PowerManagement::notifier()->powerProfileChanged(profile));
+            Solid::PowerManagement::PowerStatePrivate::notify(Solid::PowerManagement::PowerProfileChanged);
+        }
+    }
+}
+
+void PowerProfilesPrivate::slotServiceOwnerChanged()
+{
+    // the daemon (re)started or went away, switch over to the new source
+    refresh();
+}
+
+void PowerProfilesPrivate::ppdPropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated)
+{
+    Q_UNUSED(invalidated)
+    DiagnosticsPrivate::signalReceived();
+    if (interface != PPD_IFACE) {
+        return;
+    }
+
+    if (changedProperties.contains(PROP_PROFILES)) {
+        const QSet<PowerProfile> supportedProfiles = parseProfiles(changedProperties.value(PROP_PROFILES));
+        QMutexLocker locker(&m_stateMutex);
+        m_supportedProfiles = supportedProfiles;
+    }
+    if (changedProperties.contains(PROP_ACTIVE_PROFILE)) {
+        updateProfile(profileFromString(changedProperties.value(PROP_ACTIVE_PROFILE).toString()));
+    }
+}
+
+bool PowerProfilesPrivate::setProfile(PowerProfile newProfile)
+{
+    if (!supported().contains(newProfile)) {
+        qCWarning(SOLID_POWER) << Q_FUNC_INFO << "Unsupported power profile requested" << newProfile;
+        return false;
+    }
+
+    if (isDaemonAvailable()) {
+        // the change gets reported back via PropertiesChanged
+        QDBusMessage msg = QDBusMessage::createMethodCall(PPD_SERVICE, PPD_PATH, DBUS_PROPS_IFACE, QStringLiteral("Set"));
+        msg << PPD_IFACE;
+        msg << PROP_ACTIVE_PROFILE;
+        msg << QVariant::fromValue(QDBusVariant(profileToString(newProfile)));
+        DiagnosticsPrivate::trackPendingCall(PPD_SERVICE, QStringLiteral("Set ") + PROP_ACTIVE_PROFILE, QDBusConnection::systemBus().asyncCall(msg));
+        return true;
+    }
+
+    if (writeSysfsProfile(newProfile)) {
+        updateProfile(newProfile);
+        return true;
+    }
+    return false;
+}
+
+int PowerProfilesPrivate::beginHold(PowerProfile holdProfile, const QString &reason)
+{
+    if (holdProfile != Solid::PowerManagement::PerformanceProfile && holdProfile != Solid::PowerManagement::PowerSaverProfile) {
+        return -1;
+    }
+
+    Hold hold;
+    hold.profile = holdProfile;
+    hold.daemonCookie = 0;
+
+    const bool daemonAvailable = isDaemonAvailable();
+    if (daemonAvailable) {
+        ServiceHealth *health = ServiceHealth::forService(PPD_SERVICE);
+        if (!health->allowCall()) {
+            return -1;
+        }
+        // the daemon drops the hold on its own once we disconnect from the bus
+        QDBusMessage msg = QDBusMessage::createMethodCall(PPD_SERVICE, PPD_PATH, PPD_IFACE, QStringLiteral("HoldProfile"));
+        msg << profileToString(holdProfile);
+        msg << reason;
+        msg << QCoreApplication::applicationName();
+        DiagnosticsPrivate::CallTimer timer(PPD_SERVICE, QStringLiteral("HoldProfile"));
+        QDBusReply<uint> reply = QDBusConnection::systemBus().asyncCall(msg, health->timeout());
+        timer.setFailed(!reply.isValid());
+        if (!reply.isValid()) {
+            qCWarning(SOLID_POWER) << "HoldProfile" << reply.error().name() << reply.error().message();
+            health->recordFailure(reply.error());
+            return -1;
+        }
+        health->recordSuccess();
+        hold.daemonCookie = reply.value();
+    } else if (!sysfsWritable()) {
+        return -1;
+    }
+
+    int cookie;
+    PowerProfile held;
+    {
+        QMutexLocker locker(&holdsMutex);
+        cookie = nextCookie++;
+        if (!daemonAvailable && holds.isEmpty()) {
+            static bool postRoutineAdded = false;
+            if (!postRoutineAdded) {
+                qAddPostRoutine(restoreSysfsProfile);
+                postRoutineAdded = true;
+            }
+            profileBeforeHolds = profile;
+        }
+        holds.insert(cookie, hold);
+        held = heldSysfsProfile();
+    }
+    if (!daemonAvailable) {
+        applySysfsProfile(held);
+    }
+    return cookie;
+}
+
+bool PowerProfilesPrivate::stopHold(int cookie)
+{
+    Hold hold;
+    PowerProfile held;
+    {
+        QMutexLocker locker(&holdsMutex);
+        if (!holds.contains(cookie)) {
+            return false;
+        }
+        hold = holds.take(cookie);
+        held = heldSysfsProfile();
+    }
+
+    if (isDaemonAvailable()) {
+        QDBusMessage msg = QDBusMessage::createMethodCall(PPD_SERVICE, PPD_PATH, PPD_IFACE, QStringLiteral("ReleaseProfile"));
+        msg << hold.daemonCookie;
+        DiagnosticsPrivate::trackPendingCall(PPD_SERVICE, QStringLiteral("ReleaseProfile"), QDBusConnection::systemBus().asyncCall(msg));
+    } else {
+        applySysfsProfile(held);
+    }
+    return true;
+}
+
+PowerProfile PowerProfilesPrivate::heldSysfsProfile() const
+{
+    // same precedence as power-profiles-daemon: power-saver holds win over performance ones
+    PowerProfile effective = profileBeforeHolds;
+    Q_FOREACH (const Hold &hold, holds) {
+        if (hold.profile == Solid::PowerManagement::PowerSaverProfile) {
+            effective = Solid::PowerManagement::PowerSaverProfile;
+            break;
+        }
+        effective = hold.profile;
+    }
+    return effective;
+}
+
+void PowerProfilesPrivate::applySysfsProfile(PowerProfile held)
+{
+    if (held != Solid::PowerManagement::UnknownProfile && held != profile && writeSysfsProfile(held)) {
+        updateProfile(held);
+    }
+}
+
+PowerProfile PowerProfilesPrivate::readSysfsProfile()
+{
+    const QStringList policies = cpufreqPolicies();
+    if (policies.isEmpty()) {
+        return Solid::PowerManagement::UnknownProfile;
+    }
+
+    const QString epp = readSysfsString(policies.first() + QStringLiteral("/energy_performance_preference"));
+    if (!epp.isEmpty()) {
+        if (epp == QStringLiteral("performance")) {
+            return Solid::PowerManagement::PerformanceProfile;
+        } else if (epp == QStringLiteral("balance_power") || epp == QStringLiteral("power")) {
+            return Solid::PowerManagement::PowerSaverProfile;
+        }
+        return Solid::PowerManagement::BalancedProfile;
+    }
+
+    const QString governor = readSysfsString(policies.first() + QStringLiteral("/scaling_governor"));
+    if (governor == QStringLiteral("performance")) {
+        return Solid::PowerManagement::PerformanceProfile;
+    } else if (governor == QStringLiteral("powersave")) {
+        return Solid::PowerManagement::PowerSaverProfile;
+    } else if (!governor.isEmpty()) {
+        return Solid::PowerManagement::BalancedProfile;
+    }
+    return Solid::PowerManagement::UnknownProfile;
+}
+
+bool PowerProfilesPrivate::writeSysfsProfile(PowerProfile newProfile)
+{
+    const QStringList policies = cpufreqPolicies();
+    if (policies.isEmpty()) {
+        return false;
+    }
+
+    bool result = true;
+    Q_FOREACH (const QString &policy, policies) {
+        const QString eppPath = policy + QStringLiteral("/energy_performance_preference");
+        if (QFile::exists(eppPath)) {
+            QString epp;
+            switch (newProfile) {
+            case Solid::PowerManagement::PerformanceProfile:
+                epp = QStringLiteral("performance");
+                break;
+            case Solid::PowerManagement::PowerSaverProfile:
+                epp = QStringLiteral("power");
+                break;
+            default:
+                epp = QStringLiteral("balance_performance");
+            }
+            result &= writeSysfsString(eppPath, epp);
+            continue;
+        }
+
+        QString governor;
+        switch (newProfile) {
+        case Solid::PowerManagement::PerformanceProfile:
+            governor = QStringLiteral("performance");
+            break;
+        case Solid::PowerManagement::PowerSaverProfile:
+            governor = QStringLiteral("powersave");
+            break;
+        default: {
+            const QStringList available = readSysfsString(policy + QStringLiteral("/scaling_available_governors")).split(QLatin1Char(' '));
+            governor = available.contains(QStringLiteral("schedutil")) ? QStringLiteral("schedutil") : QStringLiteral("ondemand");
+        }
+        }
+        result &= writeSysfsString(policy + QStringLiteral("/scaling_governor"), governor);
+    }
+    return result;
+}
+
+bool PowerProfilesPrivate::sysfsWritable()
+{
+    const QStringList policies = cpufreqPolicies();
+    if (policies.isEmpty()) {
+        return false;
+    }
+
+    const QString eppPath = policies.first() + QStringLiteral("/energy_performance_preference");
+    if (QFile::exists(eppPath)) {
+        return QFileInfo(eppPath).isWritable();
+    }
+    return QFileInfo(policies.first() + QStringLiteral("/scaling_governor")).isWritable();
+}
+
+// public
+Solid::PowerManagement::PowerProfile Solid::PowerManagement::powerProfile()
+{
+    globalPowerProfiles->ensureInitialized();
+    return globalPowerProfiles->profile;
+}
+
+QSet<Solid::PowerManagement::PowerProfile> Solid::PowerManagement::supportedPowerProfiles()
+{
+    globalPowerProfiles->ensureInitialized();
+    return globalPowerProfiles->supported();
+}
+
+bool Solid::PowerManagement::setPowerProfile(PowerProfile profile)
+{
+    globalPowerProfiles->ensureInitialized();
+    return globalPowerProfiles->setProfile(profile);
+}
+
+int Solid::PowerManagement::beginHoldingPowerProfile(PowerProfile profile, const QString &reason)
+{
+    globalPowerProfiles->ensureInitialized();
+    return globalPowerProfiles->beginHold(profile, reason);
+}
+
+bool Solid::PowerManagement::stopHoldingPowerProfile(int cookie)
+{
+    return globalPowerProfiles->stopHold(cookie);
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_PROFILES_P_H
+#define SOLID_POWER_PROFILES_P_H
+
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QVariant>
+
+#include "powermanagement.h"
+
+#include <atomic>
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+class QDBusServiceWatcher;
+
+class PowerProfilesPrivate : public QObject
+{
+    Q_OBJECT
+public:
+    PowerProfilesPrivate();
+    ~PowerProfilesPrivate();
+
+    static PowerProfilesPrivate *instance();
+    static bool exists();
+
+    bool setProfile(Solid::PowerManagement::PowerProfile newProfile);
+    int beginHold(Solid::PowerManagement::PowerProfile holdProfile, const QString &reason);
+    bool stopHold(int cookie);
+
+    void refresh(bool notify = true);
+    // the first refresh, if it didn't happen yet; blocking
+    void ensureInitialized();
+    QSet<Solid::PowerManagement::PowerProfile> supported() const;
+    bool isDaemonAvailable() const;
+    void updateProfile(Solid::PowerManagement::PowerProfile newProfile, bool notify = true);
+
+    // cpufreq fallback, used when power-profiles-daemon isn't running
+    static Solid::PowerManagement::PowerProfile readSysfsProfile();
+    static bool writeSysfsProfile(Solid::PowerManagement::PowerProfile newProfile);
+    static bool sysfsWritable();
+    // the profile the holds call for; with holdsMutex held
+    Solid::PowerManagement::PowerProfile heldSysfsProfile() const;
+    // switches to it; without holdsMutex held, receivers may begin or stop holds
+    void applySysfsProfile(Solid::PowerManagement::PowerProfile held);
+
+public Q_SLOTS:
+    void init();
+    void slotServiceOwnerChanged();
+    void ppdPropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidated);
+
+public:
+    struct Hold {
+        Solid::PowerManagement::PowerProfile profile;
+        uint daemonCookie;
+    };
+
+    std::atomic<Solid::PowerManagement::PowerProfile> profile {Solid::PowerManagement::UnknownProfile};
+
+    QMutex holdsMutex;
+    QHash<int, Hold> holds;
+    int nextCookie = 1;
+    Solid::PowerManagement::PowerProfile profileBeforeHolds = Solid::PowerManagement::UnknownProfile;
+
+private:
+    QDBusServiceWatcher *m_watcher;
+
+    QMutex m_refreshMutex; // one refresh at a time
+    std::atomic<bool> m_initialized {false};
+
+    // written from the library's thread, read from any
+    mutable QMutex m_stateMutex;
+    QSet<Solid::PowerManagement::PowerProfile> m_supportedProfiles;
+    bool m_daemonAvailable = false;
+};
+
+#endif
@@ -0,0 +1,408 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "powerscheduler.h"
+#include "powerscheduler_p.h"
+#include "powermanagement.h"
+
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QRunnable>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// the scheduler running the current worker's task, for checkpoint()
+static thread_local PowerSchedulerPrivate *s_currentScheduler = Q_NULLPTR;
+
+// parses the kernel's CPU list format, e.g. "0-3,8,10-11"
+static QVector<int> parseCpuList(const QByteArray &list)
+{
+    QVector<int> cpus;
+    Q_FOREACH (const QByteArray &range, list.trimmed().split(',')) {
+        const int dash = range.indexOf('-');
+        bool firstOk = false;
+        bool lastOk = false;
+        const int first = range.left(dash < 0 ? range.size() : dash).toInt(&firstOk);
+        const int last = dash < 0 ? first : range.mid(dash + 1).toInt(&lastOk);
+        if (!firstOk || (dash >= 0 && !lastOk)) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.append(cpu);
+        }
+    }
+    return cpus;
+}
+
+namespace
+{
+// restricts the calling thread to some CPUs for its lifetime
+class CpuAffinityScope
+{
+public:
+    explicit CpuAffinityScope(const QVector<int> &cpus)
+    {
+#ifdef Q_OS_LINUX
+        if (cpus.isEmpty() || sched_getaffinity(0, sizeof(m_saved), &m_saved) != 0) {
+            return;
+        }
+        // within what we're allowed to run on, or we'd end up nowhere
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        Q_FOREACH (int cpu, cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &m_saved)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) > 0) {
+            m_restricted = sched_setaffinity(0, sizeof(set), &set) == 0;
+        }
+#else
+        Q_UNUSED(cpus)
+#endif
+    }
+
+    ~CpuAffinityScope()
+    {
+#ifdef Q_OS_LINUX
+        if (m_restricted) {
+            sched_setaffinity(0, sizeof(m_saved), &m_saved);
+        }
+#endif
+    }
+
+private:
+#ifdef Q_OS_LINUX
+    cpu_set_t m_saved;
+    bool m_restricted = false;
+#endif
+};
+
+class ScheduledTask : public QRunnable
+{
+public:
+    ScheduledTask(PowerSchedulerPrivate *d, const std::function<void()> &task, Solid::PowerScheduler::TaskPriority priority)
+        : m_d(d), m_task(task), m_priority(priority)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        // queued tasks don't start while suspending
+        m_d->waitWhilePaused();
+
+        QThread::Priority threadPriority;
+        bool efficiency;
+        {
+            QMutexLocker locker(&m_d->mutex);
+            threadPriority = m_d->threadPriority(m_priority);
+            efficiency = m_d->runsOnEfficiencyCores(m_priority);
+        }
+
+        // the workers are shared by all tasks, give them back as we found them
+        QThread *thread = QThread::currentThread();
+        const QThread::Priority oldPriority = thread->priority();
+        thread->setPriority(threadPriority);
+        {
+            CpuAffinityScope affinity(efficiency ? m_d->efficiencyCpus : QVector<int>());
+            PowerSchedulerPrivate *outer = s_currentScheduler;
+            s_currentScheduler = m_d;
+            m_task();
+            s_currentScheduler = outer;
+        }
+#if defined(Q_OS_LINUX) && defined(SCHED_IDLE)
+        // QThread keeps the scheduling policy on later changes, so SCHED_IDLE would stick
+        if (threadPriority == QThread::IdlePriority) {
+            sched_param param;
+            param.sched_priority = 0;
+            pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+        }
+#endif
+        thread->setPriority(oldPriority == QThread::InheritPriority ? QThread::NormalPriority : oldPriority);
+    }
+
+private:
+    PowerSchedulerPrivate *m_d;
+    std::function<void()> m_task;
+    Solid::PowerScheduler::TaskPriority m_priority;
+};
+}
+
+PowerSchedulerPrivate::PowerSchedulerPrivate()
+    : efficiencyCpus(efficiencyCores())
+{
+    maxCount = qMax(1, QThread::idealThreadCount());
+    conservingCount = efficiencyCpus.isEmpty() ? qMax(1, maxCount / 2) : qMin(efficiencyCpus.size(), maxCount);
+}
+
+QVector<int> PowerSchedulerPrivate::efficiencyCores()
+{
+#ifdef Q_OS_LINUX
+    // Intel hybrid CPUs list their E-cores under a PMU of their own
+    QFile atom(QStringLiteral("/sys/devices/cpu_atom/cpus"));
+    if (atom.open(QIODevice::ReadOnly)) {
+        const QVector<int> cpus = parseCpuList(atom.readAll());
+        if (!cpus.isEmpty()) {
+            return cpus;
+        }
+    }
+
+    // big.LITTLE and the like: the cores with less than the highest capacity
+    QMap<int, int> capacities;
+    const QDir cpuDir(QStringLiteral("/sys/devices/system/cpu"));
+    Q_FOREACH (const QString &entry, cpuDir.entryList(QStringList() << QStringLiteral("cpu*"), QDir::Dirs)) {
+        bool ok = false;
+        const int cpu = entry.mid(3).toInt(&ok);
+        if (!ok) {
+            continue;
+        }
+        QFile capacity(cpuDir.filePath(entry + QStringLiteral("/cpu_capacity")));
+        if (capacity.open(QIODevice::ReadOnly)) {
+            const int value = capacity.readAll().trimmed().toInt(&ok);
+            if (ok) {
+                capacities.insert(cpu, value);
+            }
+        }
+    }
+
+    int highest = 0;
+    Q_FOREACH (int value, capacities) {
+        highest = qMax(highest, value);
+    }
+    QVector<int> cpus;
+    for (auto it = capacities.constBegin(); it != capacities.constEnd(); ++it) {
+        if (it.value() < highest) {
+            cpus.append(it.key());
+        }
+    }
+    return cpus;
+#else
+    return QVector<int>();
+#endif
+}
+
+void PowerSchedulerPrivate::waitWhilePaused()
+{
+    QMutexLocker locker(&mutex);
+    while (paused) {
+        resumeCondition.wait(&mutex);
+    }
+}
+
+int PowerSchedulerPrivate::updateThreadCount()
+{
+    const int count = conserving ? conservingCount : maxCount;
+    if (count == pool.maxThreadCount()) {
+        return -1;
+    }
+    pool.setMaxThreadCount(count);
+    return count;
+}
+
+QThread::Priority PowerSchedulerPrivate::threadPriority(Solid::PowerScheduler::TaskPriority priority) const
+{
+    int level = priority;
+    if (conserving) {
+        --level;
+    }
+    // with the lid closed, nobody is looking at the result right away
+    if (lidClosed && priority == Solid::PowerScheduler::InteractiveTask) {
+        --level;
+    }
+
+    switch (level) {
+    case Solid::PowerScheduler::BackgroundTask:
+        return QThread::LowPriority;
+    case Solid::PowerScheduler::NormalTask:
+        return QThread::NormalPriority;
+    case Solid::PowerScheduler::InteractiveTask:
+        return QThread::HighPriority;
+    default:
+        return QThread::IdlePriority;
+    }
+}
+
+bool PowerSchedulerPrivate::runsOnEfficiencyCores(Solid::PowerScheduler::TaskPriority priority) const
+{
+    return !efficiencyCpus.isEmpty() && (conserving || priority == Solid::PowerScheduler::BackgroundTask);
+}
+
+Solid::PowerScheduler::PowerScheduler(QObject *parent)
+    : QObject(parent)
+    , d(new PowerSchedulerPrivate)
+{
+    PowerManagement::Notifier *notifier = PowerManagement::notifier();
+
+    // direct connections: the backend may emit from its I/O thread, and pausing
+    // on suspend can't wait for our event loop
+    connect(notifier, &PowerManagement::Notifier::appShouldConserveResourcesChanged, this, [this](bool conserve) {
+        int count;
+        {
+            QMutexLocker locker(&d->mutex);
+            d->conserving = conserve;
+            count = d->updateThreadCount();
+        }
+        if (count >= 0) {
+            Q_EMIT currentThreadCountChanged(count);
+        }
+    }, Qt::DirectConnection);
+
+    connect(notifier, &PowerManagement::Notifier::isLidClosedChanged, this, [this](bool closed) {
+        QMutexLocker locker(&d->mutex);
+        d->lidClosed = closed;
+    }, Qt::DirectConnection);
+
+    connect(notifier, &PowerManagement::Notifier::aboutToSuspend, this, [this]() {
+        {
+            QMutexLocker locker(&d->mutex);
+            if (d->paused) {
+                return;
+            }
+            d->paused = true;
+        }
+        Q_EMIT paused();
+    }, Qt::DirectConnection);
+
+    connect(notifier, &PowerManagement::Notifier::resumingFromSuspend, this, [this]() {
+        {
+            QMutexLocker locker(&d->mutex);
+            if (!d->paused) {
+                return;
+            }
+            d->paused = false;
+            d->resumeCondition.wakeAll();
+        }
+        Q_EMIT resumed();
+    }, Qt::DirectConnection);
+
+    // after connecting, so that no change is missed
+    const bool conserve = PowerManagement::appShouldConserveResources();
+    const bool closed = PowerManagement::isLidClosed();
+    QMutexLocker locker(&d->mutex);
+    d->conserving = conserve;
+    d->lidClosed = closed;
+    d->updateThreadCount();
+}
+
+Solid::PowerScheduler::~PowerScheduler()
+{
+    // the lambdas above use d, which goes away before QObject disconnects them
+    if (PowerManagement::Notifier *notifier = PowerManagement::notifier()) {
+        disconnect(notifier, Q_NULLPTR, this, Q_NULLPTR);
+    }
+
+    {
+        QMutexLocker locker(&d->mutex);
+        d->paused = false;
+        d->resumeCondition.wakeAll();
+    }
+    d->pool.waitForDone();
+    delete d;
+}
+
+void Solid::PowerScheduler::start(const std::function<void()> &task, TaskPriority priority)
+{
+    d->pool.start(new ScheduledTask(d, task, priority), priority);
+}
+
+void Solid::PowerScheduler::start(QRunnable *runnable, TaskPriority priority)
+{
+    start([runnable]() {
+        runnable->run();
+        if (runnable->autoDelete()) {
+            delete runnable;
+        }
+    }, priority);
+}
+
+int Solid::PowerScheduler::maxThreadCount() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->maxCount;
+}
+
+void Solid::PowerScheduler::setMaxThreadCount(int count)
+{
+    int current;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->maxCount = qMax(1, count);
+        current = d->updateThreadCount();
+    }
+    if (current >= 0) {
+        Q_EMIT currentThreadCountChanged(current);
+    }
+}
+
+int Solid::PowerScheduler::conservingThreadCount() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->conservingCount;
+}
+
+void Solid::PowerScheduler::setConservingThreadCount(int count)
+{
+    int current;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->conservingCount = qMax(1, count);
+        current = d->updateThreadCount();
+    }
+    if (current >= 0) {
+        Q_EMIT currentThreadCountChanged(current);
+    }
+}
+
+int Solid::PowerScheduler::currentThreadCount() const
+{
+    return d->pool.maxThreadCount();
+}
+
+int Solid::PowerScheduler::activeThreadCount() const
+{
+    return d->pool.activeThreadCount();
+}
+
+bool Solid::PowerScheduler::isPaused() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->paused;
+}
+
+bool Solid::PowerScheduler::hasEfficiencyCores() const
+{
+    return !d->efficiencyCpus.isEmpty();
+}
+
+bool Solid::PowerScheduler::waitForDone(int msecs)
+{
+    return d->pool.waitForDone(msecs);
+}
+
+void Solid::PowerScheduler::checkpoint()
+{
+    if (s_currentScheduler) {
+        s_currentScheduler->waitWhilePaused();
+    }
+}
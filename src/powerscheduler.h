@@ -0,0 +1,167 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <solidpower_export.h>
+
+#ifndef SOLID_POWERSCHEDULER_H
+#define SOLID_POWERSCHEDULER_H
+
+#include <QObject>
+
+#include <functional>
+
+class QRunnable;
+
+namespace Solid {
+
+class PowerSchedulerPrivate;
+
+/**
+ * A thread pool for batch work that follows the machine's power state.
+ *
+ * - While the application should conserve resources (i.e. on battery), the
+ *   pool runs fewer workers and moves all of its work to the efficiency cores,
+ *   when the CPU topology has any; background tasks always run there.
+ * - Each task runs with a thread priority derived from its TaskPriority, the
+ *   power source and the lid state.
+ * - When the system is about to suspend, no new task is started and the tasks
+ *   calling checkpoint() block in it, until the system resumes.
+ *
+ * @code
+ *   Solid::PowerScheduler scheduler;
+ *   scheduler.start([]() {
+ *       for (const QString &file : files) {
+ *           Solid::PowerScheduler::checkpoint();
+ *           index(file);
+ *       }
+ *   }, Solid::PowerScheduler::BackgroundTask);
+ * @endcode
+ *
+ * @since 5.x
+ */
+class SOLIDPOWER_EXPORT PowerScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * How urgent a task is, deciding both its place in the queue and the
+     * priority of the thread running it
+     */
+    enum TaskPriority {
+        //! Work nobody waits for, e.g. indexing
+        BackgroundTask = 0,
+        //! The default
+        NormalTask,
+        //! Work the user is waiting for
+        InteractiveTask
+    };
+
+    explicit PowerScheduler(QObject *parent = Q_NULLPTR);
+
+    /**
+     * Resumes the pool if paused and waits for all the tasks to finish.
+     */
+    ~PowerScheduler();
+
+    /**
+     * Queues @p task to run on one of the workers.
+     */
+    void start(const std::function<void()> &task, TaskPriority priority = NormalTask);
+
+    /**
+     * Queues @p runnable to run on one of the workers; it's deleted afterwards
+     * if its autoDelete() is true.
+     */
+    void start(QRunnable *runnable, TaskPriority priority = NormalTask);
+
+    /**
+     * @return the number of workers while running on AC power, by default
+     * QThread::idealThreadCount()
+     */
+    int maxThreadCount() const;
+    void setMaxThreadCount(int count);
+
+    /**
+     * @return the number of workers while conserving resources, by default the
+     * number of efficiency cores, or else half of the cores
+     */
+    int conservingThreadCount() const;
+    void setConservingThreadCount(int count);
+
+    /**
+     * @return the number of workers allowed right now
+     */
+    int currentThreadCount() const;
+
+    /**
+     * @return the number of workers currently running a task
+     */
+    int activeThreadCount() const;
+
+    /**
+     * @return whether the pool is held because the system is suspending
+     */
+    bool isPaused() const;
+
+    /**
+     * @return whether the CPU has efficiency cores the work can be moved to
+     */
+    bool hasEfficiencyCores() const;
+
+    /**
+     * Waits up to @p msecs milliseconds (forever if -1) for all the tasks to
+     * finish, returns whether they did.
+     */
+    bool waitForDone(int msecs = -1);
+
+    /**
+     * To be called by long running tasks between two units of work: blocks
+     * while the scheduler running the calling task is paused. Does nothing
+     * when called from outside a PowerScheduler task.
+     */
+    static void checkpoint();
+
+Q_SIGNALS:
+    /**
+     * This signal is emitted when the system is about to suspend and the pool
+     * stops starting tasks. It may be emitted from any thread.
+     */
+    void paused();
+
+    /**
+     * This signal is emitted when the system resumed from suspend and the pool
+     * runs again. It may be emitted from any thread.
+     */
+    void resumed();
+
+    /**
+     * This signal is emitted when the number of workers allowed changes,
+     * following the power source. It may be emitted from any thread.
+     * @param count the new number of workers
+     */
+    void currentThreadCountChanged(int count);
+
+private:
+    PowerSchedulerPrivate *const d;
+};
+
+} // namespace Solid
+
+#endif
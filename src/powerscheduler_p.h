@@ -0,0 +1,61 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWERSCHEDULER_P_H
+#define SOLID_POWERSCHEDULER_P_H
+
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "powerscheduler.h"
+
+class PowerSchedulerPrivate
+{
+public:
+    PowerSchedulerPrivate();
+
+    // CPUs with less than the highest capacity, empty on homogeneous machines
+    static QVector<int> efficiencyCores();
+
+    // blocks the calling worker while paused
+    void waitWhilePaused();
+
+    // with the mutex held; returns the new count, or -1 if it didn't change
+    int updateThreadCount();
+    QThread::Priority threadPriority(Solid::PowerScheduler::TaskPriority priority) const;
+    bool runsOnEfficiencyCores(Solid::PowerScheduler::TaskPriority priority) const;
+
+    QThreadPool pool;
+    const QVector<int> efficiencyCpus;
+
+    // the power state, updated from whatever thread the Notifier emits in
+    QMutex mutex;
+    QWaitCondition resumeCondition;
+    bool paused = false;
+    bool conserving = false;
+    bool lidClosed = false;
+    int maxCount;
+    int conservingCount;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_STATE_P_H
+#define SOLID_POWER_STATE_P_H
+
+#include <QSharedData>
+
+#include "powermanagement.h"
+
+namespace Solid
+{
+namespace PowerManagement
+{
+class PowerStatePrivate : public QSharedData
+{
+public:
+    bool conserveResources = false;
+    bool hasLid = false;
+    bool lidClosed = false;
+    PowerProfile profile = UnknownProfile;
+    ThermalPressure thermalPressure = NominalThermalPressure;
+
+    // assembles the current state from the cached values, never queries anything
+    static PowerState snapshot();
+
+    // emits Notifier::stateChanged(), call once per incoming message
+    static void notify(ChangedFlags changes);
+
+    // implemented by the backend, fills in the state it owns
+    static void fillBackendState(PowerStatePrivate *d);
+};
+}
+}
+
+#endif
@@ -0,0 +1,283 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QElapsedTimer>
+#include <QGlobalStatic>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QTimer>
+
+#include <climits>
+
+#include "powertrace_p.h"
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+#define TRACE_MAGIC "SPTR"
+#define TRACE_VERSION 1
+
+// the UPower properties the backend follows, by bit in the change records
+static const char *const s_upowerProperties[] = { "OnBattery", "LidIsPresent", "LidIsClosed" };
+
+namespace
+{
+class TraceRecorder
+{
+public:
+    TraceRecorder()
+    {
+        m_file.setFileName(QFile::decodeName(qgetenv("SOLID_POWER_RECORD")));
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qCWarning(SOLID_POWER) << "Cannot record the power trace to" << m_file.fileName() << m_file.errorString();
+            return;
+        }
+        m_file.write(TRACE_MAGIC, 4);
+        m_file.putChar(char(TRACE_VERSION));
+        m_file.flush();
+        m_clock.start();
+        m_ok = true;
+    }
+
+    void write(PowerTrace::RecordType type, const QByteArray &payload)
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_ok) {
+            return;
+        }
+
+        const quint64 now = quint64(m_clock.nsecsElapsed() / 1000);
+        quint64 delta = now - m_last;
+        m_last = now;
+
+        QByteArray record;
+        record.append(char(type));
+        do {
+            const char byte = char(delta & 0x7f);
+            delta >>= 7;
+            record.append(delta ? char(byte | 0x80) : byte);
+        } while (delta);
+        record.append(payload);
+
+        m_file.write(record);
+        // right away, what came just before a crash is often the interesting part
+        m_file.flush();
+    }
+
+private:
+    QMutex m_mutex;
+    QFile m_file;
+    QElapsedTimer m_clock;
+    quint64 m_last = 0;
+    bool m_ok = false;
+};
+}
+
+Q_GLOBAL_STATIC(TraceRecorder, globalRecorder)
+
+bool PowerTrace::isRecording()
+{
+    static const bool recording = !qEnvironmentVariableIsEmpty("SOLID_POWER_RECORD");
+    return recording;
+}
+
+bool PowerTrace::isReplaying()
+{
+    static const bool replaying = !qEnvironmentVariableIsEmpty("SOLID_POWER_REPLAY");
+    return replaying;
+}
+
+void PowerTrace::recordUPowerChange(const QVariantMap &changedProperties)
+{
+    if (!isRecording()) {
+        return;
+    }
+
+    quint8 mask = 0;
+    quint8 values = 0;
+    for (int i = 0; i < 3; ++i) {
+        const QString name = QLatin1String(s_upowerProperties[i]);
+        if (changedProperties.contains(name)) {
+            mask |= 1 << i;
+            if (changedProperties.value(name).toBool()) {
+                values |= 1 << i;
+            }
+        }
+    }
+    if (!mask) {
+        return;
+    }
+
+    QByteArray payload;
+    payload.append(char(mask));
+    payload.append(char(values));
+    globalRecorder->write(UPowerChangeRecord, payload);
+}
+
+void PowerTrace::recordSignal(RecordType type, bool value)
+{
+    if (!isRecording()) {
+        return;
+    }
+    globalRecorder->write(type, QByteArray(1, char(value)));
+}
+
+void PowerTrace::recordReply(RecordType type, const QString &name, bool value)
+{
+    if (!isRecording()) {
+        return;
+    }
+    const QByteArray latin1 = name.toLatin1().left(255);
+    QByteArray payload;
+    payload.append(char(latin1.size()));
+    payload.append(latin1);
+    payload.append(char(value));
+    globalRecorder->write(type, payload);
+}
+
+PowerTrace::Replayer::Replayer(const std::function<void(const Record &)> &sink, QObject *parent)
+    : QObject(parent)
+    , m_sink(sink)
+    , m_timer(new QTimer(this))
+{
+    m_file.setFileName(QFile::decodeName(qgetenv("SOLID_POWER_REPLAY")));
+    bool ok = false;
+    const double speed = qgetenv("SOLID_POWER_REPLAY_SPEED").toDouble(&ok);
+    if (ok && speed >= 0) {
+        m_speed = speed;
+    }
+
+    m_timer->setSingleShot(true);
+    // the recorded pace is only honored to the millisecond
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &Replayer::next);
+}
+
+void PowerTrace::Replayer::start()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCWarning(SOLID_POWER) << "Cannot replay the power trace" << m_file.fileName() << m_file.errorString();
+        return;
+    }
+    char version;
+    if (m_file.read(4) != TRACE_MAGIC || !m_file.getChar(&version) || version != TRACE_VERSION) {
+        qCWarning(SOLID_POWER) << m_file.fileName() << "is not a power trace";
+        return;
+    }
+
+    qCDebug(SOLID_POWER) << "Replaying the power trace" << m_file.fileName() << "at speed" << m_speed;
+    m_hasPending = readRecord(&m_pending);
+    if (m_hasPending) {
+        schedule(0);
+    }
+}
+
+void PowerTrace::Replayer::next()
+{
+    if (!m_hasPending) {
+        return;
+    }
+
+    // read ahead before delivering, the sink may take a while
+    const Record record = m_pending;
+    m_hasPending = readRecord(&m_pending);
+    m_sink(record);
+    ++m_delivered;
+
+    if (m_hasPending) {
+        schedule(record.timestamp);
+    } else {
+        qCDebug(SOLID_POWER) << "Power trace replayed," << m_delivered << "records";
+    }
+}
+
+void PowerTrace::Replayer::schedule(quint64 from)
+{
+    qint64 msecs = 0;
+    if (m_speed > 0) {
+        msecs = qRound64((m_pending.timestamp - from) / 1000.0 / m_speed);
+    }
+    m_timer->start(int(qMin<qint64>(msecs, INT_MAX)));
+}
+
+bool PowerTrace::Replayer::readRecord(Record *record)
+{
+    char type;
+    if (!m_file.getChar(&type)) {
+        return false;
+    }
+
+    quint64 delta = 0;
+    int shift = 0;
+    char byte;
+    do {
+        if (!m_file.getChar(&byte)) {
+            return false;
+        }
+        delta |= quint64(byte & 0x7f) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 64);
+    m_timestamp += delta;
+
+    record->type = RecordType(type);
+    record->timestamp = m_timestamp;
+    record->properties.clear();
+    record->name.clear();
+    record->value = false;
+
+    char value;
+    switch (type) {
+    case UPowerChangeRecord: {
+        char mask;
+        if (!m_file.getChar(&mask) || !m_file.getChar(&value)) {
+            return false;
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (mask & (1 << i)) {
+                record->properties.insert(QLatin1String(s_upowerProperties[i]), bool(value & (1 << i)));
+            }
+        }
+        return true;
+    }
+    case PrepareForSleepRecord:
+    case PrepareForShutdownRecord:
+        if (!m_file.getChar(&value)) {
+            return false;
+        }
+        record->value = value != 0;
+        return true;
+    case Login1ReplyRecord:
+    case UPowerReplyRecord: {
+        char length;
+        if (!m_file.getChar(&length)) {
+            return false;
+        }
+        const QByteArray name = m_file.read(quint8(length));
+        if (name.size() != quint8(length) || !m_file.getChar(&value)) {
+            return false;
+        }
+        record->name = QString::fromLatin1(name);
+        record->value = value != 0;
+        return true;
+    }
+    default:
+        qCWarning(SOLID_POWER) << "Unknown record type" << int(type) << "in" << m_file.fileName();
+        return false;
+    }
+}
@@ -0,0 +1,103 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_POWERTRACE_P_H
+#define SOLID_POWER_POWERTRACE_P_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QObject>
+#include <QVariantMap>
+
+#include <functional>
+
+class QTimer;
+
+/*
+ * Record and replay of the backend's inputs: the D-Bus replies it gets and
+ * the signals it receives, with their timing.
+ *
+ * With SOLID_POWER_RECORD=<file>, they are appended to a compact binary
+ * trace. With SOLID_POWER_REPLAY=<file>, the backend doesn't touch the bus and
+ * is fed the trace instead, at the recorded pace times
+ * SOLID_POWER_REPLAY_SPEED (1 by default, 0 for as fast as possible).
+ *
+ * The trace starts with "SPTR" and a version byte, followed by the records:
+ * a type byte, the time since the previous record in microseconds as an
+ * unsigned LEB128 varint, then the type's payload.
+ */
+namespace PowerTrace
+{
+enum RecordType {
+    // payload: a mask of the properties present and their values, one byte each
+    UPowerChangeRecord = 1,
+    // payload: the signal's argument, one byte
+    PrepareForSleepRecord,
+    PrepareForShutdownRecord,
+    // payload: the name's length, one byte, its Latin-1 characters, the value, one byte
+    Login1ReplyRecord,
+    UPowerReplyRecord
+};
+
+struct Record {
+    RecordType type;
+    quint64 timestamp; // microseconds since the start of the trace
+    QVariantMap properties; // UPowerChangeRecord
+    QString name; // the Can* method or property, for replies
+    bool value;
+};
+
+bool isRecording();
+bool isReplaying();
+
+void recordUPowerChange(const QVariantMap &changedProperties);
+void recordSignal(RecordType type, bool value);
+void recordReply(RecordType type, const QString &name, bool value);
+
+// feeds a trace to a sink, living in the sink's thread
+class Replayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Replayer(const std::function<void(const Record &)> &sink, QObject *parent = Q_NULLPTR);
+
+public Q_SLOTS:
+    void start();
+
+private Q_SLOTS:
+    void next();
+
+private:
+    bool readRecord(Record *record);
+    // arms the timer for the pending record, @p from being the time of the one before
+    void schedule(quint64 from);
+
+    std::function<void(const Record &)> m_sink;
+    QFile m_file;
+    double m_speed = 1.0;
+    QTimer *m_timer;
+    Record m_pending;
+    bool m_hasPending = false;
+    quint64 m_timestamp = 0;
+    quint64 m_delivered = 0;
+};
+}
+
+#endif
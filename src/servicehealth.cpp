@@ -0,0 +1,209 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDBusServiceWatcher>
+#include <QDebug>
+#include <QGlobalStatic>
+#include <QLoggingCategory>
+
+#include "iothread_p.h"
+#include "servicehealth_p.h"
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+#define DEFAULT_TIMEOUT 5000 // msecs; the D-Bus default of 25s freezes callers for far too long
+#define FAILURE_THRESHOLD 3 // consecutive timeouts before the circuit opens
+#define MIN_BACKOFF 5000
+#define MAX_BACKOFF 300000
+
+Q_GLOBAL_STATIC(ServiceHealthRegistry, globalServiceHealth)
+
+static int configuredTimeout(const QString &service)
+{
+    const QString spec = QString::fromLocal8Bit(qgetenv("SOLID_POWER_DBUS_TIMEOUT"));
+    if (spec.isEmpty()) {
+        return DEFAULT_TIMEOUT;
+    }
+
+    bool ok;
+    const int global = spec.toInt(&ok);
+    if (ok && global > 0) {
+        return global;
+    }
+
+    Q_FOREACH (const QString &entry, spec.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const int sep = entry.lastIndexOf(QLatin1Char('='));
+        if (sep > 0 && entry.left(sep) == service) {
+            const int timeout = entry.mid(sep + 1).toInt(&ok);
+            if (ok && timeout > 0) {
+                return timeout;
+            }
+        }
+    }
+    return DEFAULT_TIMEOUT;
+}
+
+ServiceHealth::ServiceHealth(const QString &service):
+    m_service(service),
+    m_timeout(configuredTimeout(service))
+{
+}
+
+ServiceHealth *ServiceHealth::forService(const QString &service, QDBusConnection::BusType bus)
+{
+    return globalServiceHealth->forService(service, bus);
+}
+
+ServiceHealth *ServiceHealth::forUnwatchedService(const QString &service)
+{
+    return globalServiceHealth->forService(service, QDBusConnection::SystemBus, false);
+}
+
+int ServiceHealth::timeout() const
+{
+    return m_timeout;
+}
+
+bool ServiceHealth::allowCall()
+{
+    QMutexLocker locker(&m_mutex);
+    switch (m_state) {
+    case Closed:
+        return true;
+    case Open:
+        if (m_openedAt.hasExpired(m_backoff)) {
+            m_state = HalfOpen;
+            qCDebug(SOLID_POWER) << "Probing" << m_service << "after" << m_backoff << "ms";
+            return true;
+        }
+        return false;
+    case HalfOpen:
+        return false; // the probe is still in flight
+    }
+    return true;
+}
+
+void ServiceHealth::recordSuccess()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_state != Closed) {
+        qCDebug(SOLID_POWER) << m_service << "is responding again";
+    }
+    m_state = Closed;
+    m_consecutiveTimeouts = 0;
+    m_backoff = 0;
+}
+
+void ServiceHealth::recordFailure(const QDBusError &error)
+{
+    recordFailure(error.type() == QDBusError::NoReply || error.type() == QDBusError::Timeout || error.type() == QDBusError::TimedOut);
+}
+
+void ServiceHealth::recordFailure(bool timedOut)
+{
+    // only a hung service is a problem, errors come back quickly
+    if (!timedOut) {
+        QMutexLocker locker(&m_mutex);
+        if (m_state == HalfOpen) {
+            m_state = Closed;
+        }
+        m_consecutiveTimeouts = 0;
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    ++m_consecutiveTimeouts;
+    if (m_state == HalfOpen || m_consecutiveTimeouts >= FAILURE_THRESHOLD) {
+        m_backoff = m_backoff == 0 ? MIN_BACKOFF : qMin(m_backoff * 2, MAX_BACKOFF);
+        m_state = Open;
+        m_openedAt.start();
+        qCWarning(SOLID_POWER) << m_service << "is not responding, using the last known values for the next" << m_backoff << "ms";
+    }
+}
+
+void ServiceHealth::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state = Closed;
+    m_consecutiveTimeouts = 0;
+    m_backoff = 0;
+}
+
+ServiceHealth::State ServiceHealth::state() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_state;
+}
+
+QVariant ServiceHealth::lastValue(const QString &key, const QVariant &defaultValue) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastValues.value(key, defaultValue);
+}
+
+void ServiceHealth::setLastValue(const QString &key, const QVariant &value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_lastValues.insert(key, value);
+}
+
+ServiceHealthRegistry::ServiceHealthRegistry()
+{
+    // we might be created from any thread, live in the library's one
+    IoThread::adopt(this);
+}
+
+ServiceHealthRegistry::~ServiceHealthRegistry()
+{
+    qDeleteAll(m_services);
+}
+
+ServiceHealth *ServiceHealthRegistry::forService(const QString &service, QDBusConnection::BusType bus, bool watch)
+{
+    QMutexLocker locker(&m_mutex);
+    ServiceHealth *&health = m_services[service];
+    if (!health) {
+        health = new ServiceHealth(service);
+        if (watch) {
+            QMetaObject::invokeMethod(this, "watchService", Qt::QueuedConnection, Q_ARG(QString, service), Q_ARG(int, bus));
+        }
+    }
+    return health;
+}
+
+void ServiceHealthRegistry::watchService(const QString &service, int bus)
+{
+    const QDBusConnection connection = bus == QDBusConnection::SessionBus ? QDBusConnection::sessionBus() : QDBusConnection::systemBus();
+    QDBusServiceWatcher *watcher = new QDBusServiceWatcher(service, connection, QDBusServiceWatcher::WatchForOwnerChange, this);
+    connect(watcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &ServiceHealthRegistry::serviceOwnerChanged);
+}
+
+void ServiceHealthRegistry::serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+{
+    Q_UNUSED(oldOwner)
+    if (newOwner.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (ServiceHealth *health = m_services.value(service)) {
+        health->reset();
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_SERVICE_HEALTH_P_H
+#define SOLID_SERVICE_HEALTH_P_H
+
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QVariant>
+
+/*
+ * Per-service call timeout and circuit breaker.
+ *
+ * A service that times out several times in a row is considered hung: the
+ * circuit opens and callers get the last known value (or their default)
+ * without touching the bus. After a backoff period, a single probe call is let
+ * through; its success closes the circuit again, as does the service getting a
+ * new owner on the bus (i.e. restarting).
+ *
+ * The timeouts can be configured with SOLID_POWER_DBUS_TIMEOUT, either as a
+ * single value in milliseconds for all services, or per service:
+ *   SOLID_POWER_DBUS_TIMEOUT=org.freedesktop.login1=1000,org.freedesktop.UPower=500
+ */
+class ServiceHealth
+{
+public:
+    enum State {
+        Closed, // healthy, calls go through
+        Open, // hung, calls are short-circuited
+        HalfOpen // backoff elapsed, one probe call is in flight
+    };
+
+    static ServiceHealth *forService(const QString &service, QDBusConnection::BusType bus = QDBusConnection::SystemBus);
+    /*
+     * Same, without the QtDBus service watcher: for the sd-bus backend, which
+     * watches the owner on its own connection and calls reset() itself.
+     */
+    static ServiceHealth *forUnwatchedService(const QString &service);
+
+    int timeout() const;
+
+    /*
+     * Whether a call may be made now; false while the circuit is open. When the
+     * backoff has elapsed, it returns true exactly once to let a probe through.
+     */
+    bool allowCall();
+
+    void recordSuccess();
+    void recordFailure(const QDBusError &error);
+    // only timeouts count towards opening the circuit
+    void recordFailure(bool timedOut);
+    void reset();
+
+    State state() const;
+
+    // last known good values, served while the circuit is open
+    QVariant lastValue(const QString &key, const QVariant &defaultValue = QVariant()) const;
+    void setLastValue(const QString &key, const QVariant &value);
+
+private:
+    explicit ServiceHealth(const QString &service);
+
+    QString m_service;
+    int m_timeout;
+    mutable QMutex m_mutex;
+    State m_state = Closed;
+    int m_consecutiveTimeouts = 0;
+    int m_backoff = 0; // msecs
+    QElapsedTimer m_openedAt;
+    QHash<QString, QVariant> m_lastValues;
+
+    friend class ServiceHealthRegistry;
+};
+
+/*
+ * Owns the ServiceHealth objects and resets them when their service gets a
+ * new owner; lives in the main thread, for its service watchers.
+ */
+class ServiceHealthRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    ServiceHealthRegistry();
+    ~ServiceHealthRegistry();
+
+    ServiceHealth *forService(const QString &service, QDBusConnection::BusType bus, bool watch = true);
+
+private Q_SLOTS:
+    void watchService(const QString &service, int bus);
+    void serviceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner);
+
+private:
+    QMutex m_mutex;
+    QHash<QString, ServiceHealth *> m_services;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QGlobalStatic>
+#include <QLoggingCategory>
+#include <QMutex>
+
+#include "powermanagement.h"
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+#define MEM_SLEEP_FILE QStringLiteral("/sys/power/mem_sleep")
+
+namespace
+{
+// the kernel's mem_sleep modes, read afresh on every call: anything with write
+// access may change them behind our back, and it's a single sysfs read
+struct SuspendModes
+{
+    QSet<Solid::PowerManagement::SuspendMode> supported;
+    Solid::PowerManagement::SuspendMode current = Solid::PowerManagement::UnknownSuspendMode;
+};
+}
+
+// serializes setSuspendMode(), its write and read back
+Q_GLOBAL_STATIC(QMutex, globalSuspendModeMutex)
+
+static Solid::PowerManagement::SuspendMode modeFromString(const QByteArray &mode)
+{
+    if (mode == "s2idle") {
+        return Solid::PowerManagement::SuspendToIdleMode;
+    } else if (mode == "shallow") {
+        return Solid::PowerManagement::ShallowSuspendMode;
+    } else if (mode == "deep") {
+        return Solid::PowerManagement::DeepSuspendMode;
+    }
+    return Solid::PowerManagement::UnknownSuspendMode;
+}
+
+static QByteArray modeToString(Solid::PowerManagement::SuspendMode mode)
+{
+    switch (mode) {
+    case Solid::PowerManagement::SuspendToIdleMode:
+        return QByteArrayLiteral("s2idle");
+    case Solid::PowerManagement::ShallowSuspendMode:
+        return QByteArrayLiteral("shallow");
+    case Solid::PowerManagement::DeepSuspendMode:
+        return QByteArrayLiteral("deep");
+    default:
+        return QByteArray();
+    }
+}
+
+static SuspendModes readSuspendModes()
+{
+    SuspendModes modes;
+
+    // e.g. "s2idle [deep]", the current mode in brackets
+    QFile file(MEM_SLEEP_FILE);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return modes;
+    }
+    Q_FOREACH (const QByteArray &token, file.readAll().simplified().split(' ')) {
+        const bool current = token.startsWith('[') && token.endsWith(']');
+        const Solid::PowerManagement::SuspendMode mode = modeFromString(current ? token.mid(1, token.size() - 2) : token);
+        if (mode == Solid::PowerManagement::UnknownSuspendMode) {
+            continue;
+        }
+        modes.supported += mode;
+        if (current) {
+            modes.current = mode;
+        }
+    }
+    return modes;
+}
+
+QSet<Solid::PowerManagement::SuspendMode> Solid::PowerManagement::supportedSuspendModes()
+{
+    return readSuspendModes().supported;
+}
+
+Solid::PowerManagement::SuspendMode Solid::PowerManagement::suspendMode()
+{
+    return readSuspendModes().current;
+}
+
+bool Solid::PowerManagement::setSuspendMode(Solid::PowerManagement::SuspendMode mode)
+{
+    QMutexLocker locker(globalSuspendModeMutex);
+    const SuspendModes modes = readSuspendModes();
+    if (!modes.supported.contains(mode)) {
+        qCWarning(SOLID_POWER) << "Unsupported suspend mode requested" << mode;
+        return false;
+    }
+    if (mode == modes.current) {
+        return true;
+    }
+
+    QFile file(MEM_SLEEP_FILE);
+    const QByteArray value = modeToString(mode);
+    if (!file.open(QIODevice::WriteOnly) || file.write(value) != value.size()) {
+        qCWarning(SOLID_POWER) << "Cannot set the suspend mode" << value << file.errorString();
+        return false;
+    }
+    file.close();
+    // read back, the kernel has the last word
+    return readSuspendModes().current == mode;
+}
@@ -15,12 +15,492 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+
+#include <QCommandLineParser>
 #include <QCoreApplication>
-#include <QDebug>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
 
 #include "powermanagement.h"
 #include "platform.h"
 
+using namespace Solid;
+
+static bool s_json = false;
+
+static QTextStream &out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+static QString sleepStateName(PowerManagement::SleepState state)
+{
+    switch (state) {
+    case PowerManagement::StandbyState:
+        return QStringLiteral("standby");
+    case PowerManagement::SuspendState:
+        return QStringLiteral("suspend");
+    case PowerManagement::HibernateState:
+        return QStringLiteral("hibernate");
+    case PowerManagement::HybridSuspendState:
+        return QStringLiteral("hybrid-suspend");
+    case PowerManagement::SuspendThenHibernateState:
+        return QStringLiteral("suspend-then-hibernate");
+    }
+    return QString::number(state);
+}
+
+static QString suspendModeName(PowerManagement::SuspendMode mode)
+{
+    switch (mode) {
+    case PowerManagement::UnknownSuspendMode:
+        return QStringLiteral("unknown");
+    case PowerManagement::SuspendToIdleMode:
+        return QStringLiteral("s2idle");
+    case PowerManagement::ShallowSuspendMode:
+        return QStringLiteral("shallow");
+    case PowerManagement::DeepSuspendMode:
+        return QStringLiteral("deep");
+    }
+    return QString::number(mode);
+}
+
+static QString profileName(PowerManagement::PowerProfile profile)
+{
+    switch (profile) {
+    case PowerManagement::UnknownProfile:
+        return QStringLiteral("unknown");
+    case PowerManagement::PowerSaverProfile:
+        return QStringLiteral("power-saver");
+    case PowerManagement::BalancedProfile:
+        return QStringLiteral("balanced");
+    case PowerManagement::PerformanceProfile:
+        return QStringLiteral("performance");
+    }
+    return QString::number(profile);
+}
+
+static QString pressureName(PowerManagement::ThermalPressure pressure)
+{
+    switch (pressure) {
+    case PowerManagement::NominalThermalPressure:
+        return QStringLiteral("nominal");
+    case PowerManagement::ModerateThermalPressure:
+        return QStringLiteral("moderate");
+    case PowerManagement::HeavyThermalPressure:
+        return QStringLiteral("heavy");
+    case PowerManagement::CriticalThermalPressure:
+        return QStringLiteral("critical");
+    }
+    return QString::number(pressure);
+}
+
+static QString chassisName(Platform::Chassis chassis)
+{
+    switch (chassis) {
+    case Platform::Chassis::Unknown:
+        return QStringLiteral("unknown");
+    case Platform::Chassis::Desktop:
+        return QStringLiteral("desktop");
+    case Platform::Chassis::Laptop:
+        return QStringLiteral("laptop");
+    case Platform::Chassis::Server:
+        return QStringLiteral("server");
+    case Platform::Chassis::Tablet:
+        return QStringLiteral("tablet");
+    case Platform::Chassis::Phone:
+        return QStringLiteral("phone");
+    case Platform::Chassis::VM:
+        return QStringLiteral("vm");
+    case Platform::Chassis::Container:
+        return QStringLiteral("container");
+    }
+    return QString::number(int(chassis));
+}
+
+template<typename T>
+static QJsonArray names(const QSet<T> &values, QString (*name)(T))
+{
+    QStringList list;
+    for (T value : values) {
+        list << name(value);
+    }
+    list.sort();
+    return QJsonArray::fromStringList(list);
+}
+
+static QString valueText(const QJsonValue &value)
+{
+    if (value.isBool()) {
+        return value.toBool() ? QStringLiteral("yes") : QStringLiteral("no");
+    } else if (value.isDouble()) {
+        return QString::number(value.toDouble());
+    } else if (value.isString()) {
+        return value.toString();
+    } else if (value.isArray()) {
+        QStringList items;
+        for (const QJsonValue &item : value.toArray()) {
+            items << (item.isString() ? item.toString() : valueText(item));
+        }
+        return items.join(QStringLiteral(", "));
+    } else if (value.isObject()) {
+        return QString::fromUtf8(QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact));
+    }
+    return QString();
+}
+
+static QString timestamp()
+{
+    return QDateTime::currentDateTimeUtc().toString(QStringLiteral("yyyy-MM-dd'T'HH:mm:ss.zzz'Z'"));
+}
+
+static void printJson(const QJsonObject &object)
+{
+    out() << QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact)) << endl;
+}
+
+static QJsonObject wakeupReport()
+{
+    const PowerManagement::WakeupReport report = PowerManagement::lastWakeupReport();
+    QJsonObject result;
+    result.insert(QStringLiteral("valid"), report.isValid);
+    if (!report.isValid) {
+        return result;
+    }
+    result.insert(QStringLiteral("sleepDuration"), double(report.sleepDuration));
+    result.insert(QStringLiteral("wakeupIrq"), report.wakeupIrq);
+    QJsonArray sources;
+    for (const PowerManagement::WakeupSource &source : report.sources) {
+        QJsonObject entry;
+        entry.insert(QStringLiteral("name"), source.name);
+        entry.insert(QStringLiteral("events"), double(source.events));
+        entry.insert(QStringLiteral("wakeups"), double(source.wakeups));
+        sources.append(entry);
+    }
+    result.insert(QStringLiteral("sources"), sources);
+    return result;
+}
+
+// one line per event, with its time
+static void printEvent(const QString &event, const QJsonObject &details = QJsonObject())
+{
+    if (s_json) {
+        QJsonObject object = details;
+        object.insert(QStringLiteral("time"), timestamp());
+        object.insert(QStringLiteral("event"), event);
+        printJson(object);
+        return;
+    }
+
+    QString line = timestamp() + QLatin1Char(' ') + event;
+    for (auto it = details.constBegin(); it != details.constEnd(); ++it) {
+        line += QLatin1Char(' ') + it.key() + QLatin1Char('=') + valueText(it.value());
+    }
+    out() << line << endl;
+}
+
+struct Field {
+    const char *section;
+    const char *key;
+    const char *label;
+    QJsonValue value;
+};
+
+static const struct {
+    const char *key;
+    const char *title;
+} s_sections[] = {
+    { "power", "Power saving mode" },
+    { "sleep", "Sleep methods" },
+    { "shutdown", "Reboot/shutdown" },
+    { "profile", "Power profile" },
+    { "platform", "Platform" }
+};
+
+static QVector<Field> snapshot()
+{
+    QVector<Field> fields;
+    fields << Field{ "power", "onBattery", "Is on battery", PowerManagement::appShouldConserveResources() }
+           << Field{ "power", "hasLid", "Has lid", PowerManagement::hasLid() }
+           << Field{ "power", "lidClosed", "Is lid closed", PowerManagement::isLidClosed() }
+           << Field{ "sleep", "canSuspend", "Can suspend", PowerManagement::canSuspend() }
+           << Field{ "sleep", "canHibernate", "Can hibernate", PowerManagement::canHibernate() }
+           << Field{ "sleep", "canHybridSleep", "Can hybrid sleep", PowerManagement::canHybridSleep() }
+           << Field{ "sleep", "canSuspendThenHibernate", "Can suspend then hibernate", PowerManagement::canSuspendThenHibernate() }
+           << Field{ "sleep", "supportedSleepStates", "Supported sleep methods", names(PowerManagement::supportedSleepStates(), sleepStateName) }
+           << Field{ "sleep", "supportedSuspendModes", "Supported suspend modes", names(PowerManagement::supportedSuspendModes(), suspendModeName) }
+           << Field{ "sleep", "suspendMode", "Suspend mode", suspendModeName(PowerManagement::suspendMode()) }
+           << Field{ "sleep", "lastWakeup", "Last wakeup", wakeupReport() }
+           << Field{ "shutdown", "canReboot", "Can reboot", PowerManagement::canReboot() }
+           << Field{ "shutdown", "canShutdown", "Can shutdown (poweroff)", PowerManagement::canShutdown() }
+           << Field{ "profile", "powerProfile", "Power profile", profileName(PowerManagement::powerProfile()) }
+           << Field{ "profile", "supportedPowerProfiles", "Supported power profiles", names(PowerManagement::supportedPowerProfiles(), profileName) }
+           << Field{ "profile", "thermalPressure", "Thermal pressure", pressureName(PowerManagement::thermalPressure()) }
+           << Field{ "platform", "chassis", "Chassis", chassisName(Platform::chassis()) }
+           << Field{ "platform", "hostname", "Hostname", Platform::hostname() }
+           << Field{ "platform", "iconName", "Icon name", Platform::iconName() }
+           << Field{ "platform", "prettyOSName", "Pretty OS name", Platform::prettyOSName() };
+    return fields;
+}
+
+static QJsonObject snapshotJson(const QVector<Field> &fields)
+{
+    QJsonObject result;
+    for (const Field &field : fields) {
+        const QString section = QLatin1String(field.section);
+        QJsonObject object = result.value(section).toObject();
+        object.insert(QLatin1String(field.key), field.value);
+        result.insert(section, object);
+    }
+    return result;
+}
+
+static void printSnapshot()
+{
+    const QVector<Field> fields = snapshot();
+    if (s_json) {
+        QJsonObject object = snapshotJson(fields);
+        object.insert(QStringLiteral("time"), timestamp());
+        printJson(object);
+        return;
+    }
+
+    bool first = true;
+    for (const auto &section : s_sections) {
+        out() << (first ? "" : "\n") << section.title << ':' << endl;
+        first = false;
+        for (const Field &field : fields) {
+            if (qstrcmp(field.section, section.key) == 0) {
+                out() << "  " << field.label << ": " << valueText(field.value) << endl;
+            }
+        }
+    }
+}
+
+static void watch()
+{
+    PowerManagement::Notifier *notifier = PowerManagement::notifier();
+    QObject::connect(notifier, &PowerManagement::Notifier::appShouldConserveResourcesChanged, [](bool onBattery) {
+        QJsonObject details;
+        details.insert(QStringLiteral("onBattery"), onBattery);
+        printEvent(QStringLiteral("appShouldConserveResourcesChanged"), details);
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::isLidClosedChanged, [](bool closed) {
+        QJsonObject details;
+        details.insert(QStringLiteral("closed"), closed);
+        printEvent(QStringLiteral("isLidClosedChanged"), details);
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::aboutToSuspend, []() {
+        printEvent(QStringLiteral("aboutToSuspend"));
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::resumingFromSuspend, []() {
+        QJsonObject details;
+        details.insert(QStringLiteral("wakeup"), wakeupReport());
+        printEvent(QStringLiteral("resumingFromSuspend"), details);
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::shuttingDown, []() {
+        printEvent(QStringLiteral("shuttingDown"));
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::powerProfileChanged, [](PowerManagement::PowerProfile profile) {
+        QJsonObject details;
+        details.insert(QStringLiteral("profile"), profileName(profile));
+        printEvent(QStringLiteral("powerProfileChanged"), details);
+    });
+    QObject::connect(notifier, &PowerManagement::Notifier::thermalPressureChanged, [](PowerManagement::ThermalPressure pressure) {
+        QJsonObject details;
+        details.insert(QStringLiteral("pressure"), pressureName(pressure));
+        printEvent(QStringLiteral("thermalPressureChanged"), details);
+    });
+
+    Platform::Notifier *platform = Platform::notifier();
+    QObject::connect(platform, &Platform::Notifier::chassisChanged, [](Platform::Chassis chassis) {
+        QJsonObject details;
+        details.insert(QStringLiteral("chassis"), chassisName(chassis));
+        printEvent(QStringLiteral("chassisChanged"), details);
+    });
+    QObject::connect(platform, &Platform::Notifier::hostnameChanged, [](const QString &hostname) {
+        QJsonObject details;
+        details.insert(QStringLiteral("hostname"), hostname);
+        printEvent(QStringLiteral("hostnameChanged"), details);
+    });
+    QObject::connect(platform, &Platform::Notifier::iconNameChanged, [](const QString &iconName) {
+        QJsonObject details;
+        details.insert(QStringLiteral("iconName"), iconName);
+        printEvent(QStringLiteral("iconNameChanged"), details);
+    });
+    QObject::connect(platform, &Platform::Notifier::prettyOSNameChanged, [](const QString &prettyOSName) {
+        QJsonObject details;
+        details.insert(QStringLiteral("prettyOSName"), prettyOSName);
+        printEvent(QStringLiteral("prettyOSNameChanged"), details);
+    });
+
+    // the state the events apply to, once subscribed so that none gets lost in between
+    QJsonObject details;
+    details.insert(QStringLiteral("state"), snapshotJson(snapshot()));
+    printEvent(QStringLiteral("snapshot"), details);
+}
+
+// latencies in nanoseconds, in call order
+struct Samples {
+    QString name;
+    QVector<qint64> latencies;
+    int failures = 0;
+};
+
+static double percentile(const QVector<qint64> &sorted, double p)
+{
+    // nearest rank
+    const int rank = int(std::ceil(p / 100.0 * sorted.size()));
+    return sorted.at(qBound(0, rank - 1, sorted.size() - 1)) / 1000.0;
+}
+
+static QJsonObject statistics(const Samples &samples)
+{
+    QJsonObject result;
+    result.insert(QStringLiteral("name"), samples.name);
+    result.insert(QStringLiteral("calls"), samples.latencies.size());
+    result.insert(QStringLiteral("failures"), samples.failures);
+    if (samples.latencies.isEmpty()) {
+        return result;
+    }
+
+    QVector<qint64> sorted = samples.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    // the first call is usually the one filling the caches, see it on its own
+    result.insert(QStringLiteral("first"), samples.latencies.first() / 1000.0);
+    result.insert(QStringLiteral("min"), sorted.first() / 1000.0);
+    result.insert(QStringLiteral("p50"), percentile(sorted, 50));
+    result.insert(QStringLiteral("p90"), percentile(sorted, 90));
+    result.insert(QStringLiteral("p99"), percentile(sorted, 99));
+    result.insert(QStringLiteral("max"), sorted.last() / 1000.0);
+    return result;
+}
+
+static Samples timeQuery(const QString &name, int iterations, const std::function<void()> &query)
+{
+    Samples samples;
+    samples.name = name;
+    samples.latencies.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        query();
+        samples.latencies << timer.nsecsElapsed();
+    }
+    return samples;
+}
+
+// times both ends of an inhibition, in pairs
+static void timeInhibition(const QString &begin, const QString &stop, int iterations,
+                           const std::function<int()> &beginCall, const std::function<bool(int)> &stopCall,
+                           QVector<Samples> *results)
+{
+    Samples beginSamples;
+    beginSamples.name = begin;
+    Samples stopSamples;
+    stopSamples.name = stop;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        const int cookie = beginCall();
+        beginSamples.latencies << timer.nsecsElapsed();
+        if (cookie < 0) {
+            ++beginSamples.failures;
+            continue;
+        }
+
+        timer.start();
+        const bool stopped = stopCall(cookie);
+        stopSamples.latencies << timer.nsecsElapsed();
+        if (!stopped) {
+            ++stopSamples.failures;
+        }
+        // let the replies to the asynchronous calls come in
+        QCoreApplication::processEvents();
+    }
+    *results << beginSamples << stopSamples;
+}
+
+static void benchmark(int iterations)
+{
+    const QString reason = QStringLiteral("solidpower-console benchmark");
+    QVector<Samples> results;
+
+    results << timeQuery(QStringLiteral("appShouldConserveResources"), iterations, []() { PowerManagement::appShouldConserveResources(); })
+            << timeQuery(QStringLiteral("hasLid"), iterations, []() { PowerManagement::hasLid(); })
+            << timeQuery(QStringLiteral("isLidClosed"), iterations, []() { PowerManagement::isLidClosed(); })
+            << timeQuery(QStringLiteral("canSuspend"), iterations, []() { PowerManagement::canSuspend(); })
+            << timeQuery(QStringLiteral("canHibernate"), iterations, []() { PowerManagement::canHibernate(); })
+            << timeQuery(QStringLiteral("canHybridSleep"), iterations, []() { PowerManagement::canHybridSleep(); })
+            << timeQuery(QStringLiteral("canSuspendThenHibernate"), iterations, []() { PowerManagement::canSuspendThenHibernate(); })
+            << timeQuery(QStringLiteral("canReboot"), iterations, []() { PowerManagement::canReboot(); })
+            << timeQuery(QStringLiteral("canShutdown"), iterations, []() { PowerManagement::canShutdown(); })
+            << timeQuery(QStringLiteral("supportedSleepStates"), iterations, []() { PowerManagement::supportedSleepStates(); })
+            << timeQuery(QStringLiteral("supportedSuspendModes"), iterations, []() { PowerManagement::supportedSuspendModes(); })
+            << timeQuery(QStringLiteral("suspendMode"), iterations, []() { PowerManagement::suspendMode(); })
+            << timeQuery(QStringLiteral("powerProfile"), iterations, []() { PowerManagement::powerProfile(); })
+            << timeQuery(QStringLiteral("supportedPowerProfiles"), iterations, []() { PowerManagement::supportedPowerProfiles(); })
+            << timeQuery(QStringLiteral("thermalPressure"), iterations, []() { PowerManagement::thermalPressure(); })
+            << timeQuery(QStringLiteral("lastWakeupReport"), iterations, []() { PowerManagement::lastWakeupReport(); });
+
+    timeInhibition(QStringLiteral("beginSuppressingSleep"), QStringLiteral("stopSuppressingSleep"), iterations,
+                   [&reason]() { return PowerManagement::beginSuppressingSleep(reason); },
+                   PowerManagement::stopSuppressingSleep, &results);
+    timeInhibition(QStringLiteral("beginSuppressingScreenPowerManagement"), QStringLiteral("stopSuppressingScreenPowerManagement"), iterations,
+                   [&reason]() { return PowerManagement::beginSuppressingScreenPowerManagement(reason); },
+                   PowerManagement::stopSuppressingScreenPowerManagement, &results);
+    // holding another profile than the active one would switch the whole system back and forth
+    const PowerManagement::PowerProfile profile = PowerManagement::powerProfile();
+    if (profile == PowerManagement::PerformanceProfile || profile == PowerManagement::PowerSaverProfile) {
+        timeInhibition(QStringLiteral("beginHoldingPowerProfile"), QStringLiteral("stopHoldingPowerProfile"), iterations,
+                       [profile, &reason]() { return PowerManagement::beginHoldingPowerProfile(profile, reason); },
+                       PowerManagement::stopHoldingPowerProfile, &results);
+    }
+
+    if (s_json) {
+        QJsonArray calls;
+        for (const Samples &samples : results) {
+            calls.append(statistics(samples));
+        }
+        QJsonObject object;
+        object.insert(QStringLiteral("time"), timestamp());
+        object.insert(QStringLiteral("iterations"), iterations);
+        object.insert(QStringLiteral("unit"), QStringLiteral("us"));
+        object.insert(QStringLiteral("calls"), calls);
+        printJson(object);
+        return;
+    }
+
+    out() << "Latencies of " << iterations << " iterations, in microseconds:" << endl;
+    out() << QStringLiteral("call").leftJustified(40);
+    const QStringList columns = QStringList() << QStringLiteral("first") << QStringLiteral("min") << QStringLiteral("p50")
+                                              << QStringLiteral("p90") << QStringLiteral("p99") << QStringLiteral("max");
+    for (const QString &column : columns) {
+        out() << column.rightJustified(11);
+    }
+    out() << "  failures" << endl;
+    for (const Samples &samples : results) {
+        const QJsonObject stats = statistics(samples);
+        out() << samples.name.leftJustified(40);
+        for (const QString &column : columns) {
+            const QJsonValue value = stats.value(column);
+            out() << (value.isDouble() ? QString::number(value.toDouble(), 'f', 1) : QStringLiteral("-")).rightJustified(11);
+        }
+        out() << QString::number(samples.failures).rightJustified(10) << endl;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
@@ -29,45 +509,39 @@ int main(int argc, char *argv[])
     app.setApplicationName(QStringLiteral("SolidPower"));
     app.setApplicationVersion(QStringLiteral("0.1"));
 
-    QObject::connect(Solid::PowerManagement::notifier(), &Solid::PowerManagement::Notifier::appShouldConserveResourcesChanged,
-                     [](bool onBattery) {
-        qDebug() << "The system is now on battery:" << onBattery;
-    });
-
-    if (Solid::PowerManagement::hasLid()) {
-        QObject::connect(Solid::PowerManagement::notifier(), &Solid::PowerManagement::Notifier::isLidClosedChanged,
-                         [](bool closed) {
-            qDebug() << "The laptop lid is now closed:" << closed;
-        });
-    }
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Queries and monitors the power management of the system."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption watchOption(QStringLiteral("watch"),
+                                   QStringLiteral("Keep running, printing the power management events as they happen."));
+    parser.addOption(watchOption);
+    QCommandLineOption jsonOption(QStringLiteral("json"),
+                                  QStringLiteral("Print JSON objects, one per line."));
+    parser.addOption(jsonOption);
+    QCommandLineOption benchOption(QStringLiteral("bench"),
+                                   QStringLiteral("Time <iterations> calls of every query and inhibition, and print the latency percentiles."),
+                                   QStringLiteral("iterations"));
+    parser.addOption(benchOption);
+    parser.process(app);
 
-    QObject::connect(Solid::PowerManagement::notifier(), &Solid::PowerManagement::Notifier::aboutToSuspend,
-                     []() {
-        qDebug() << "The system is going to suspend...";
-    });
+    s_json = parser.isSet(jsonOption);
 
-    QObject::connect(Solid::PowerManagement::notifier(), &Solid::PowerManagement::Notifier::resumingFromSuspend,
-                     []() {
-        qDebug() << "The system is resuming...";
-    });
+    if (parser.isSet(benchOption)) {
+        bool ok = false;
+        const int iterations = parser.value(benchOption).toInt(&ok);
+        if (!ok || iterations < 1) {
+            QTextStream(stderr) << "The number of iterations must be a positive integer" << endl;
+            return 1;
+        }
+        benchmark(iterations);
+    } else if (!parser.isSet(watchOption)) {
+        printSnapshot();
+    }
 
-    qDebug() << "Power saving mode:";
-    qDebug() << "Is on battery:" << Solid::PowerManagement::appShouldConserveResources();
-    qDebug() << "Has lid:" << Solid::PowerManagement::hasLid();
-    qDebug() << "Is lid closed:" << Solid::PowerManagement::isLidClosed();
-    qDebug() << "\nSleep methods:";
-    qDebug() << "Can suspend:" << Solid::PowerManagement::canSuspend();
-    qDebug() << "Can hibernate:" << Solid::PowerManagement::canHibernate();
-    qDebug() << "Can hybrid sleep:" << Solid::PowerManagement::canHybridSleep();
-    qDebug() << "Supported sleep methods (as above):" << Solid::PowerManagement::supportedSleepStates();
-    qDebug() << "\nReboot/shutdown:";
-    qDebug() << "Can reboot:" << Solid::PowerManagement::canReboot();
-    qDebug() << "Can shutdown (poweroff):" << Solid::PowerManagement::canShutdown();
-    qDebug() << "\nPlatform:";
-    qDebug() << "Chassis:" << (int)Solid::Platform::chassis();
-    qDebug() << "Hostname:" << Solid::Platform::hostname();
-    qDebug() << "Icon name:" << Solid::Platform::iconName();
-    qDebug() << "Pretty OS name:" << Solid::Platform::prettyOSName();
-
-    return app.exec();
+    if (parser.isSet(watchOption)) {
+        watch();
+        return app.exec();
+    }
+    return 0;
 }
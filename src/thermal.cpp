@@ -0,0 +1,258 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QDir>
+#include <QGlobalStatic>
+
+#include "powermanagement.h"
+#include "powerstate_p.h"
+#include "thermal_p.h"
+#include "diagnostics_p.h"
+#include "iothread_p.h"
+
+#include <climits>
+
+#define THERMAL_PATH QStringLiteral("/sys/class/thermal")
+
+// margins in millidegrees Celsius
+#define MODERATE_MARGIN 10000 // below the passive trip point
+#define CRITICAL_MARGIN 5000 // below the hot/critical trip point
+#define FALLBACK_PASSIVE_MARGIN 20000 // below the critical trip point, for zones without a passive one
+
+// under heavy pressure that holds steady, the samples back off to this (msecs)
+#define STEADY_HEAVY_TIME 30000
+#define STEADY_HEAVY_INTERVAL 5000
+
+Q_GLOBAL_STATIC(ThermalMonitor, globalThermalMonitor)
+
+static QByteArray readSysfs(const QString &path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        return file.readAll().trimmed();
+    }
+    return QByteArray();
+}
+
+ThermalMonitor::ThermalMonitor():
+    m_timer(this)
+{
+    qRegisterMetaType<Solid::PowerManagement::ThermalPressure>("Solid::PowerManagement::ThermalPressure");
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &ThermalMonitor::sample);
+
+    // we might be created from any thread, live in the library's one
+    IoThread::adopt(this);
+
+    discover();
+}
+
+ThermalMonitor::~ThermalMonitor()
+{
+}
+
+ThermalMonitor *ThermalMonitor::instance()
+{
+    return globalThermalMonitor;
+}
+
+bool ThermalMonitor::exists()
+{
+    return globalThermalMonitor.exists();
+}
+
+void ThermalMonitor::discover()
+{
+    // the trip points are static, only the temperatures need to be sampled
+    const QStringList zones = QDir(THERMAL_PATH).entryList(QStringList() << QStringLiteral("thermal_zone*"), QDir::Dirs);
+    Q_FOREACH (const QString &zone, zones) {
+        const QString zonePath = THERMAL_PATH + QLatin1Char('/') + zone;
+        ThermalZone tz;
+        for (int i = 0; ; ++i) {
+            const QString tripPath = zonePath + QStringLiteral("/trip_point_%1_").arg(i);
+            const QByteArray type = readSysfs(tripPath + QStringLiteral("type"));
+            if (type.isEmpty()) {
+                break;
+            }
+            const int temp = readSysfs(tripPath + QStringLiteral("temp")).toInt();
+            if (temp <= 0) {
+                continue;
+            }
+            if (type == "passive" && (tz.passive == 0 || temp < tz.passive)) {
+                tz.passive = temp;
+            } else if ((type == "hot" || type == "critical") && (tz.critical == 0 || temp < tz.critical)) {
+                tz.critical = temp;
+            }
+        }
+        if (tz.passive == 0 && tz.critical == 0) {
+            continue; // nothing to compare against
+        }
+        if (tz.passive == 0) {
+            tz.passive = tz.critical - FALLBACK_PASSIVE_MARGIN;
+        }
+
+        tz.tempPath = zonePath + QStringLiteral("/temp");
+        tz.tempFile.reset(new QFile(tz.tempPath));
+        if (tz.tempFile->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            m_zones.append(tz);
+        }
+    }
+
+    const QStringList devices = QDir(THERMAL_PATH).entryList(QStringList() << QStringLiteral("cooling_device*"), QDir::Dirs);
+    Q_FOREACH (const QString &device, devices) {
+        const QString devicePath = THERMAL_PATH + QLatin1Char('/') + device;
+        const QByteArray type = readSysfs(devicePath + QStringLiteral("/type"));
+        // only the devices that throttle the CPU matter, fans don't slow anything down
+        if (type == "Processor" || type == "intel_powerclamp" || type.startsWith("cpufreq") || type.startsWith("thermal-cpufreq")) {
+            m_coolingDevices << devicePath + QStringLiteral("/cur_state");
+        }
+    }
+
+    qCDebug(SOLID_POWER) << "Thermal zones:" << m_zones.count() << "CPU cooling devices:" << m_coolingDevices.count();
+}
+
+bool ThermalMonitor::processorCoolingActive() const
+{
+    Q_FOREACH (const QString &device, m_coolingDevices) {
+        if (readSysfs(device).toInt() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Solid::PowerManagement::ThermalPressure ThermalMonitor::classify(int &headroom, bool ownFiles)
+{
+    Solid::PowerManagement::ThermalPressure result = Solid::PowerManagement::NominalThermalPressure;
+    headroom = INT_MAX; // distance to the next threshold
+
+    // the zones themselves never change after discover()
+    for (int i = 0; i < m_zones.count(); ++i) {
+        const ThermalZone &tz = m_zones.at(i);
+        int temp;
+        if (ownFiles) {
+            temp = readSysfs(tz.tempPath).toInt();
+        } else {
+            tz.tempFile->seek(0);
+            temp = tz.tempFile->readAll().trimmed().toInt();
+        }
+        if (temp <= 0) {
+            continue;
+        }
+
+        Solid::PowerManagement::ThermalPressure zonePressure;
+        if (tz.critical > 0 && temp >= tz.critical - CRITICAL_MARGIN) {
+            zonePressure = Solid::PowerManagement::CriticalThermalPressure;
+        } else if (temp >= tz.passive) {
+            zonePressure = Solid::PowerManagement::HeavyThermalPressure;
+            if (tz.critical > 0) {
+                headroom = qMin(headroom, tz.critical - CRITICAL_MARGIN - temp);
+            }
+        } else if (temp >= tz.passive - MODERATE_MARGIN) {
+            zonePressure = Solid::PowerManagement::ModerateThermalPressure;
+            headroom = qMin(headroom, tz.passive - temp);
+        } else {
+            zonePressure = Solid::PowerManagement::NominalThermalPressure;
+            headroom = qMin(headroom, tz.passive - MODERATE_MARGIN - temp);
+        }
+        result = qMax(result, zonePressure);
+    }
+
+    if (result < Solid::PowerManagement::HeavyThermalPressure && processorCoolingActive()) {
+        result = Solid::PowerManagement::HeavyThermalPressure;
+    }
+    return result;
+}
+
+Solid::PowerManagement::ThermalPressure ThermalMonitor::currentPressure()
+{
+    if (!m_monitoring) {
+        // nobody's listening, so nothing keeps the value current; a sample is cheap enough,
+        // but the monitor's files are only for its own thread
+        int headroom;
+        return classify(headroom, true);
+    }
+    return m_pressure;
+}
+
+Solid::PowerManagement::ThermalPressure ThermalMonitor::lastPressure() const
+{
+    return m_pressure;
+}
+
+void ThermalMonitor::setMonitoring(bool enabled)
+{
+    if (enabled == m_monitoring || m_zones.isEmpty()) {
+        return;
+    }
+
+    m_monitoring = enabled;
+    if (enabled) {
+        sample();
+    } else {
+        m_timer.stop();
+    }
+}
+
+void ThermalMonitor::sample()
+{
+    int headroom;
+    const Solid::PowerManagement::ThermalPressure pressure = classify(headroom);
+    if (pressure != m_pressure || !m_levelAge.isValid()) {
+        m_levelAge.start();
+    }
+    if (pressure != m_pressure) {
+        m_pressure = pressure;
+        SOLID_EMIT_SIGNAL("thermalPressureChanged", Solid::PowerManagement::notifier()->thermalPressureChanged(m_pressure));
+        Solid::PowerManagement::PowerStatePrivate::notify(Solid::PowerManagement::ThermalPressureChanged);
+    }
+
+    if (!m_monitoring) {
+        return;
+    }
+
+    // sample rarely while far away from any threshold, often when close to one
+    // except under heavy pressure that doesn't change anymore, the system just runs hot
+    int interval;
+    if (m_pressure == Solid::PowerManagement::HeavyThermalPressure && headroom > 2000 &&
+            m_levelAge.elapsed() >= STEADY_HEAVY_TIME) {
+        interval = STEADY_HEAVY_INTERVAL;
+    } else if (m_pressure >= Solid::PowerManagement::HeavyThermalPressure || headroom <= 2000) {
+        interval = 1000;
+    } else if (headroom <= 5000) {
+        interval = 2000;
+    } else if (headroom <= 10000) {
+        interval = 5000;
+    } else if (headroom <= 20000) {
+        interval = 10000;
+    } else {
+        interval = 30000;
+    }
+    m_timer.setTimerType(interval >= 10000 ? Qt::VeryCoarseTimer : Qt::CoarseTimer);
+    m_timer.start(interval);
+}
+
+// public
+Solid::PowerManagement::ThermalPressure Solid::PowerManagement::thermalPressure()
+{
+    return globalThermalMonitor->currentPressure();
+}
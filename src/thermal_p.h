@@ -0,0 +1,79 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_POWER_THERMAL_P_H
+#define SOLID_POWER_THERMAL_P_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+
+#include "powermanagement.h"
+
+#include <atomic>
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+struct ThermalZone
+{
+    QSharedPointer<QFile> tempFile; // kept open, re-read from the start for each sample, in our thread
+    QString tempPath; // for the samples taken from other threads
+    int passive = 0; // lowest passive trip point, in millidegrees Celsius; 0 if none
+    int critical = 0; // lowest hot/critical trip point
+};
+
+class ThermalMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    ThermalMonitor();
+    ~ThermalMonitor();
+
+    static ThermalMonitor *instance();
+    static bool exists();
+
+    // callable from any thread
+    Solid::PowerManagement::ThermalPressure currentPressure();
+    // the last sampled value, without sampling
+    Solid::PowerManagement::ThermalPressure lastPressure() const;
+
+public Q_SLOTS:
+    void setMonitoring(bool enabled);
+    void sample();
+
+private:
+    void discover();
+    // @p ownFiles: opens the files anew, for callers outside our thread
+    Solid::PowerManagement::ThermalPressure classify(int &headroom, bool ownFiles = false);
+    bool processorCoolingActive() const;
+
+    QVector<ThermalZone> m_zones;
+    QStringList m_coolingDevices;
+    QTimer m_timer;
+    std::atomic<bool> m_monitoring {false};
+    QElapsedTimer m_levelAge; // since the last change of m_pressure
+    std::atomic<Solid::PowerManagement::ThermalPressure> m_pressure {Solid::PowerManagement::NominalThermalPressure};
+};
+
+#endif
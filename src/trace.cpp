@@ -0,0 +1,217 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+
+#include <time.h>
+#include <unistd.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+#include "trace_p.h"
+
+std::atomic<TracePrivate::TraceSink *> TracePrivate::sink(nullptr);
+
+TracePrivate::TraceSink::~TraceSink()
+{
+}
+
+namespace
+{
+// the kernel's thread id on Linux, matching perf and /proc
+quint64 currentThreadId()
+{
+#ifdef Q_OS_LINUX
+    return quint64(syscall(SYS_gettid));
+#else
+    return quint64(QThread::currentThreadId());
+#endif
+}
+
+QByteArray jsonEscaped(const QString &string)
+{
+    const QByteArray utf8 = string.toUtf8();
+    QByteArray escaped;
+    escaped.reserve(utf8.size());
+    for (const char c : utf8) {
+        switch (c) {
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        case '\r':
+            escaped += "\\r";
+            break;
+        case '\t':
+            escaped += "\\t";
+            break;
+        default:
+            if (uchar(c) < 0x20) {
+                char code[7];
+                qsnprintf(code, sizeof(code), "\\u%04x", uchar(c));
+                escaped += code;
+            } else {
+                escaped += c;
+            }
+        }
+    }
+    return escaped;
+}
+
+/*
+ * Writes the Chrome trace-event format; the closing bracket of the event
+ * array is optional, so the file stays valid however the process ends.
+ */
+class ChromeTraceSink : public TracePrivate::TraceSink
+{
+public:
+    explicit ChromeTraceSink(const QString &path):
+        m_file(path),
+        m_pid(getpid())
+    {
+        if (m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            m_file.write("[\n");
+            m_file.flush();
+        }
+    }
+
+    bool isOpen() const
+    {
+        return m_file.isOpen();
+    }
+
+    void write(const TracePrivate::TraceEvent &event) Q_DECL_OVERRIDE
+    {
+        QByteArray line = "{\"name\":\"" + jsonEscaped(event.name) + "\",\"cat\":\"" + event.category + "\",\"ph\":\"" + event.phase +
+                          "\",\"ts\":" + QByteArray::number(event.timestamp);
+        if (event.phase == 'X') {
+            line += ",\"dur\":" + QByteArray::number(event.duration);
+        } else {
+            line += ",\"s\":\"t\"";
+        }
+        line += ",\"pid\":" + QByteArray::number(m_pid) +
+                ",\"tid\":" + QByteArray::number(currentThreadId()) + "},\n";
+
+        QMutexLocker locker(&m_mutex);
+        m_file.write(line);
+        m_file.flush(); // keep everything up to a hang or crash
+    }
+
+private:
+    QMutex m_mutex;
+    QFile m_file;
+    qint64 m_pid;
+};
+
+#ifdef HAVE_SYS_SDT_H
+class UsdtTraceSink : public TracePrivate::TraceSink
+{
+public:
+    void write(const TracePrivate::TraceEvent &event) Q_DECL_OVERRIDE
+    {
+        const QByteArray name = event.name.toUtf8();
+        if (event.phase == 'X') {
+            DTRACE_PROBE4(solidpower, complete, event.category, name.constData(), event.timestamp, event.duration);
+        } else {
+            DTRACE_PROBE3(solidpower, instant, event.category, name.constData(), event.timestamp);
+        }
+    }
+};
+#endif
+
+// picks the sink from the environment when the library gets loaded
+struct TraceSetup
+{
+    TraceSetup()
+    {
+#if SOLIDPOWER_TRACING
+        const QByteArray spec = qgetenv("SOLID_POWER_TRACE");
+        if (spec.startsWith("chrome:")) {
+            ChromeTraceSink *chrome = new ChromeTraceSink(QFile::decodeName(spec.mid(qstrlen("chrome:"))));
+            if (chrome->isOpen()) {
+                TracePrivate::setSink(chrome);
+            } else {
+                delete chrome;
+            }
+        }
+#ifdef HAVE_SYS_SDT_H
+        else if (spec == "usdt") {
+            TracePrivate::setSink(new UsdtTraceSink);
+        }
+#endif
+#endif
+    }
+
+    ~TraceSetup()
+    {
+        TracePrivate::setSink(nullptr);
+    }
+};
+
+TraceSetup traceSetup;
+}
+
+void TracePrivate::setSink(TraceSink *newSink)
+{
+    // the old sink is leaked on purpose when replaced at runtime: another
+    // thread may still be writing to it
+    TraceSink *old = sink.exchange(newSink);
+    if (!newSink) {
+        delete old;
+    }
+}
+
+qint64 TracePrivate::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void TracePrivate::instant(const char *category, const QString &name)
+{
+    TraceSink *current = sink.load(std::memory_order_acquire);
+    if (current) {
+        const TraceEvent event = { 'i', category, name, now(), 0 };
+        current->write(event);
+    }
+}
+
+void TracePrivate::complete(const char *category, const QString &name, qint64 start)
+{
+    TraceSink *current = sink.load(std::memory_order_acquire);
+    if (current) {
+        const TraceEvent event = { 'X', category, name, start, now() - start };
+        current->write(event);
+    }
+}
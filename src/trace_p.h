@@ -0,0 +1,125 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_TRACE_P_H
+#define SOLID_TRACE_P_H
+
+#include <QString>
+
+#include <atomic>
+
+#include "config-solidpower.h"
+
+/*
+ * Structured trace events around backend calls, init phases, inhibitions and
+ * Notifier signal emission.
+ *
+ * The sink is chosen at startup from the SOLID_POWER_TRACE environment variable:
+ *   SOLID_POWER_TRACE=chrome:/path/to/trace.json  Chrome trace-event JSON (chrome://tracing, Perfetto)
+ *   SOLID_POWER_TRACE=usdt                        USDT probes solidpower:begin/end/instant (if built with sys/sdt.h)
+ *
+ * Without a sink, each trace point costs one relaxed atomic load; building with
+ * SOLIDPOWER_TRACING=OFF removes them altogether.
+ */
+namespace TracePrivate
+{
+struct TraceEvent
+{
+    char phase; // 'X' complete, 'i' instant, as in the Chrome trace-event format
+    const char *category;
+    QString name;
+    qint64 timestamp; // CLOCK_MONOTONIC, in microseconds
+    qint64 duration;
+};
+
+class TraceSink
+{
+public:
+    virtual ~TraceSink();
+    virtual void write(const TraceEvent &event) = 0;
+};
+
+extern std::atomic<TraceSink *> sink;
+
+inline bool enabled()
+{
+    return sink.load(std::memory_order_relaxed) != nullptr;
+}
+
+/*
+ * Installs a sink (taking ownership), or removes the current one when null.
+ */
+void setSink(TraceSink *newSink);
+
+qint64 now();
+void instant(const char *category, const QString &name);
+void complete(const char *category, const QString &name, qint64 start);
+
+/*
+ * Times the rest of the enclosing scope; the name is a callable, so that it
+ * only gets built while tracing.
+ */
+class TraceScope
+{
+public:
+    template<typename NameFunction>
+    TraceScope(const char *category, NameFunction name)
+    {
+        if (enabled()) {
+            m_category = category;
+            m_name = name();
+            m_start = now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_category) {
+            complete(m_category, m_name, m_start);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *m_category = nullptr;
+    QString m_name;
+    qint64 m_start = 0;
+};
+}
+
+#define SOLID_TRACE_CONCAT_IMPL(a, b) a##b
+#define SOLID_TRACE_CONCAT(a, b) SOLID_TRACE_CONCAT_IMPL(a, b)
+
+#if SOLIDPOWER_TRACING
+// traces the rest of the enclosing scope; name is only evaluated when tracing
+#define SOLID_TRACE_SCOPE(category, name) \
+    TracePrivate::TraceScope SOLID_TRACE_CONCAT(solidTraceScope, __LINE__)(category, [&]() -> QString { return name; })
+#define SOLID_TRACE_INSTANT(category, name) \
+    do { \
+        if (TracePrivate::enabled()) \
+            TracePrivate::instant(category, name); \
+    } while (0)
+#else
+#define SOLID_TRACE_SCOPE(category, name) do {} while (0)
+#define SOLID_TRACE_INSTANT(category, name) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+    Copyright 2015 Lukáš Tinkl <ltinkl@redhat.com>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QGlobalStatic>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QMutex>
+
+#include <algorithm>
+
+#include <time.h>
+
+#include "powermanagement.h"
+#include "wakeupreport_p.h"
+#include "trace_p.h"
+
+Q_DECLARE_LOGGING_CATEGORY(SOLID_POWER)
+
+#define WAKEUP_CLASS_DIR QStringLiteral("/sys/class/wakeup")
+#define WAKEUP_IRQ_FILE QStringLiteral("/sys/power/pm_wakeup_irq")
+
+namespace
+{
+struct SourceCounts
+{
+    QString name;
+    quint64 events;
+    quint64 wakeups;
+};
+
+// keyed by the sysfs entry (wakeupN), names aren't unique
+typedef QHash<QString, SourceCounts> Snapshot;
+
+struct WakeupState
+{
+    QMutex mutex;
+    bool haveBefore = false;
+    Snapshot before;
+    qint64 suspendedAt = 0; // CLOCK_BOOTTIME
+    Solid::PowerManagement::WakeupReport last;
+};
+}
+
+Q_GLOBAL_STATIC(WakeupState, globalWakeupState)
+
+static QByteArray readSysfs(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+// keeps counting while suspended, unlike CLOCK_MONOTONIC, and unlike the wall
+// clock isn't thrown off by NTP or timezone changes across the sleep
+static qint64 bootTimeMsecs()
+{
+    struct timespec ts;
+#ifdef CLOCK_BOOTTIME
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return qint64(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static Snapshot takeSnapshot()
+{
+    Snapshot snapshot;
+    const QDir dir(WAKEUP_CLASS_DIR);
+    Q_FOREACH (const QString &entry, dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QString path = dir.filePath(entry) + QLatin1Char('/');
+        SourceCounts counts;
+        counts.name = QString::fromLocal8Bit(readSysfs(path + QStringLiteral("name")));
+        counts.events = readSysfs(path + QStringLiteral("event_count")).toULongLong();
+        counts.wakeups = readSysfs(path + QStringLiteral("wakeup_count")).toULongLong();
+        snapshot.insert(entry, counts);
+    }
+    return snapshot;
+}
+
+void WakeupReportPrivate::captureBefore()
+{
+    SOLID_TRACE_SCOPE("wakeup", QStringLiteral("captureBefore"));
+    WakeupState *state = globalWakeupState;
+    if (!state) {
+        return;
+    }
+    const Snapshot snapshot = takeSnapshot();
+    QMutexLocker locker(&state->mutex);
+    state->before = snapshot;
+    state->haveBefore = true;
+    state->suspendedAt = bootTimeMsecs();
+}
+
+void WakeupReportPrivate::captureAfter()
+{
+    SOLID_TRACE_SCOPE("wakeup", QStringLiteral("captureAfter"));
+    WakeupState *state = globalWakeupState;
+    if (!state) {
+        return;
+    }
+    {
+        QMutexLocker locker(&state->mutex);
+        if (!state->haveBefore) {
+            // we only saw the resume, e.g. subscribed while suspending
+            return;
+        }
+    }
+
+    const Snapshot after = takeSnapshot();
+    // the kernel clears it when suspending, and fails the read when there's none
+    bool irqOk = false;
+    const int irq = readSysfs(WAKEUP_IRQ_FILE).toInt(&irqOk);
+
+    QMutexLocker locker(&state->mutex);
+    Solid::PowerManagement::WakeupReport report;
+    report.isValid = true;
+    report.sleepDuration = qMax<qint64>(0, bootTimeMsecs() - state->suspendedAt);
+    report.wakeupIrq = irqOk ? irq : -1;
+
+    for (auto it = after.constBegin(); it != after.constEnd(); ++it) {
+        // sources registered during the sleep count from zero
+        const auto before = state->before.constFind(it.key());
+        const bool known = before != state->before.constEnd() && before->name == it->name;
+        Solid::PowerManagement::WakeupSource source;
+        source.name = it->name;
+        source.events = known ? it->events - qMin(it->events, before->events) : it->events;
+        source.wakeups = known ? it->wakeups - qMin(it->wakeups, before->wakeups) : it->wakeups;
+        if (source.events > 0 || source.wakeups > 0) {
+            report.sources.append(source);
+        }
+    }
+    std::sort(report.sources.begin(), report.sources.end(),
+              [](const Solid::PowerManagement::WakeupSource &a, const Solid::PowerManagement::WakeupSource &b) {
+        return a.wakeups != b.wakeups ? a.wakeups > b.wakeups : a.events > b.events;
+    });
+
+    if (!report.sources.isEmpty()) {
+        qCDebug(SOLID_POWER) << "Woken up after" << report.sleepDuration << "ms by" << report.sources.first().name
+                             << "irq" << report.wakeupIrq;
+    }
+
+    state->last = report;
+    state->before.clear();
+    state->haveBefore = false;
+}
+
+Solid::PowerManagement::WakeupReport Solid::PowerManagement::lastWakeupReport()
+{
+    WakeupState *state = globalWakeupState;
+    if (!state) {
+        return WakeupReport();
+    }
+    QMutexLocker locker(&state->mutex);
+    return state->last;
+}